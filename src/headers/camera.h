@@ -61,6 +61,17 @@ public:
     struct Frustum
     {
         glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+        // Projection the planes were built from, for projected-size LOD
+        float fovY = 0.0f;           // radians
+        float aspect = 0.0f;         // width / height
+        float viewportHeight = 0.0f; // pixels, 0 = unknown
+
+        // Same frustum shape and resolution, wherever the camera is
+        bool SameProjection(const Frustum &other) const
+        {
+            return fovY == other.fovY && aspect == other.aspect && viewportHeight == other.viewportHeight;
+        }
     };
 
     // returns the view matrix calculated using Euler Angles and the LookAt Matrix
@@ -115,9 +126,12 @@ public:
             Zoom = 45.0f;
     }
 
-    Frustum GetFrustum(float aspect, float fovY, float nearPlane, float farPlane) const
+    Frustum GetFrustum(float aspect, float fovY, float nearPlane, float farPlane, float viewportHeight = 0.0f) const
     {
         Frustum frustum;
+        frustum.fovY = fovY;
+        frustum.aspect = aspect;
+        frustum.viewportHeight = viewportHeight;
 
         const float halfVSide = farPlane * tanf(fovY * 0.5f);
         const float halfHSide = halfVSide * aspect;
@@ -169,6 +183,18 @@ public:
         return true;
     }
 
+    // Check if a sphere is completely inside the frustum (contents need no further plane tests)
+    bool IsSphereFullyInFrustum(const Frustum &frustum, const glm::vec3 &center, float radius) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            float distance = glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w;
+            if (distance < radius)
+                return false;
+        }
+        return true;
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Reads a GPU-written counter back without stalling the pipeline. Copy() snapshots
+// it into a staging buffer behind a fence, Poll() picks the value up once the GPU
+// is past that fence (usually a frame later) and never waits for it. The source
+// must already be visible to buffer copies (GL_BUFFER_UPDATE_BARRIER_BIT)
+class CounterReadback
+{
+public:
+    CounterReadback() = default;
+    CounterReadback(const CounterReadback &) = delete;
+    CounterReadback &operator=(const CounterReadback &) = delete;
+
+    ~CounterReadback()
+    {
+        if (fence)
+            glDeleteSync(fence);
+        glDeleteBuffers(1, &staging);
+    }
+
+    // Snapshot the GLuint at offset in buffer, skipped while the last one is in flight
+    void Copy(unsigned int buffer, GLintptr offset)
+    {
+        if (fence)
+            return;
+
+        if (!staging)
+        {
+            glGenBuffers(1, &staging);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, staging);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), nullptr, GL_STREAM_READ);
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // True and the value once the last snapshot has landed, false while it hasn't
+    bool Poll(GLuint &value)
+    {
+        if (!fence)
+            return false;
+
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return false;
+
+        glDeleteSync(fence);
+        fence = nullptr;
+        glBindBuffer(GL_COPY_READ_BUFFER, staging);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &value);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        return true;
+    }
+
+private:
+    unsigned int staging = 0;
+    GLsync fence = nullptr;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "camera.h"
+
+struct BoundingSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+// Static bounding volume hierarchy (AABB nodes, median split) over items that never
+// move: trees, foliage cells. Cull walks it with plane masking: once a node is fully
+// inside a frustum plane its children skip that plane, a node fully outside any plane
+// or beyond maxDistance drops its whole subtree in one test, and a node inside every
+// plane and range accepts its whole subtree without visiting it.
+class CullingBVH
+{
+public:
+    // Item i of spheres is reported as i by Cull
+    void Build(const vector<BoundingSphere> &spheres, int leafSize = 4);
+
+    // Items whose sphere touches the frustum and whose nearest point is within
+    // maxDistance of cameraPos, in traversal order. fullyInside (optional, parallel to
+    // visible) is 1 where the sphere is inside every plane. Returns the nodes visited
+    int Cull(const Camera::Frustum &frustum, const glm::vec3 &cameraPos, float maxDistance,
+             vector<uint32_t> &visible, vector<uint8_t> *fullyInside = nullptr) const;
+
+    bool IsEmpty() const { return nodes.empty(); }
+    size_t GetNodeCount() const { return nodes.size(); }
+
+private:
+    struct Node
+    {
+        glm::vec3 min;
+        uint32_t begin; // items of the whole subtree are items[begin, end)
+        glm::vec3 max;
+        uint32_t end;
+        uint32_t right; // second child, the first is the next node; 0 = leaf
+    };
+
+    vector<Node> nodes;            // depth-first
+    vector<uint32_t> items;        // original indices in tree order
+    vector<BoundingSphere> bounds; // spheres in tree order
+
+    uint32_t build(uint32_t begin, uint32_t end, int leafSize);
+};
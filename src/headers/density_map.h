@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "terrain.h"
+#include "poisson_disk.h"
+
+// Circular no-placement area on the XZ plane (e.g. the fairy's clearing)
+struct ExclusionZone
+{
+    glm::vec2 center;
+    float radius;
+};
+
+// What a placement layer accepts
+struct DensityRules
+{
+    float minNormalY = 0.0f; // slope limit, 1 = flat only
+    float minHeight = -FLT_MAX;
+    float maxHeight = FLT_MAX;
+    vector<ExclusionZone> exclusions;
+};
+
+// Per-layer density rasterised over the terrain grid (one texel per terrain quad)
+// from slope, height and exclusion zones, with an alias table for O(1) sampling
+class DensityMap
+{
+public:
+    DensityMap(Terrain *terrain, const DensityRules &rules);
+
+    // Importance-sample a position, every sample lands on acceptable terrain
+    glm::vec2 Sample(PlacementRng &rng) const;
+
+    // Density in [0, 1] of the texel under (x, z)
+    float GetDensity(float x, float z) const;
+
+    // Stochastic acceptance with probability = density (deterministic per position)
+    bool Accept(float x, float z) const;
+
+    bool IsExcluded(float x, float z) const;
+    bool IsEmpty() const { return totalDensity <= 0.0f; }
+
+    // Raw texels (row-major, cellsX * cellsZ) for uploading as a texture
+    const vector<float> &GetValues() const { return values; }
+    int GetCellsX() const { return cellsX; }
+    int GetCellsZ() const { return cellsZ; }
+
+    // Upload as a GL_R8 texture covering the terrain (uv = xz / terrain size + 0.5), caller owns it
+    unsigned int CreateTexture() const;
+
+private:
+    DensityRules rules;
+    glm::vec2 origin;
+    float cellSize;
+    int cellsX, cellsZ;
+    float totalDensity = 0.0f;
+
+    vector<float> values;
+
+    // Vose alias table
+    vector<float> probability;
+    vector<uint32_t> alias;
+
+    void rasterize(Terrain *terrain);
+    void buildAliasTable();
+};
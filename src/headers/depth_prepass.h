@@ -0,0 +1,50 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+// Fragment shader variants of an alpha-tested layer, passed as the defines of
+// Shader(vertexPath, fragmentPath, true, defines)
+#define DEPTH_PREPASS_DEPTH_ONLY "#define DEPTH_ONLY\n"   // alpha test only, no shading
+#define DEPTH_PREPASS_COLOUR "#define DEPTH_EQUAL\n"      // shading only, no discard
+
+// Both programs of a layer drawn with a depth prepass. discard in the fragment shader
+// disables early-z, so dense alpha-tested foliage shades every covered fragment; with a
+// prepass the alpha test only runs in the cheap depth-only program and the colour program
+// shades exactly the surviving fragment of each pixel (GL_EQUAL, nothing discarded).
+// Both must use the same vertex shader, declared with `invariant gl_Position`
+struct DepthPrepassShaders
+{
+    Shader *depth = nullptr;
+    Shader *colour = nullptr;
+
+    bool Enabled() const { return depth != nullptr && colour != nullptr; }
+};
+
+class DepthPrepass
+{
+public:
+    // Depth writes only, the alpha test decides coverage
+    static void BeginDepthPass()
+    {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+    // Colour where the depth pass left this very fragment, depth is already final
+    static void BeginColourPass()
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_EQUAL);
+    }
+
+    static void End()
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+enum class DepthOrder
+{
+    NONE,           // draw in culling order
+    FRONT_TO_BACK,  // alpha-tested: early-z rejects what is hidden behind
+    BACK_TO_FRONT   // alpha-blended: correct compositing
+};
+
+// Orders visible instances (or cells) by view depth quantised to 16 bits with a
+// two-pass LSD radix sort, O(n) and cheap enough to run every frame at 100k+.
+// Sort() builds the permutation, Apply() reorders any parallel array with it
+class DepthSorter
+{
+public:
+    // depths = distance along the view direction, clamped to [0, maxDepth]
+    void Sort(const float *depths, size_t count, float maxDepth, DepthOrder order);
+
+    // values[i] = values[order[i]]; every array passed must have `count` entries
+    template <typename T>
+    void Apply(vector<T> &values)
+    {
+        static_assert(is_trivially_copyable<T>::value, "depth sort permutes raw bytes");
+        if (indices.empty() || values.size() != indices.size())
+            return;
+
+        permuteScratch.resize(values.size() * sizeof(T));
+        T *sorted = reinterpret_cast<T *>(permuteScratch.data());
+        for (size_t i = 0; i < indices.size(); i++)
+            sorted[i] = values[indices[i]];
+        memcpy(values.data(), sorted, values.size() * sizeof(T));
+    }
+
+    const vector<uint32_t> &GetOrder() const { return indices; }
+
+    // Timing of the last Sort (keys + both passes), for the debug output
+    float GetLastSortMs() const { return lastSortMs; }
+
+    // View depth of a point, the key Sort() expects
+    static float ViewDepth(const glm::vec3 &position, const glm::vec3 &cameraPos, const glm::vec3 &cameraFront)
+    {
+        return glm::dot(position - cameraPos, cameraFront);
+    }
+
+private:
+    vector<uint16_t> keys, keyScratch;
+    vector<uint32_t> indices, indexScratch;
+    vector<uint8_t> permuteScratch;
+    float lastSortMs = 0.0f;
+};
@@ -2,6 +2,7 @@
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <vector>
 #include <string>
 using namespace std;
@@ -10,11 +11,92 @@ using namespace std;
 #include "terrain.h"
 #include "camera.h"
 #include "lod.h"
+#include "foliage_traits.h"
+#include "density_map.h"
+#include "depth_sort.h"
+#include "depth_prepass.h"
+#include "counter_readback.h"
+#include "culling_bvh.h"
 
-enum class FoliageType
+// Stable per-instance random in [0, 1) used for density thinning.
+// Must match densityRank() in src/shaders/foliage/cull.comp
+inline float FoliageDensityRank(uint32_t index)
 {
-    GRASS,
-    FLOWER
+    uint32_t h = index * 747796405u + 2891336453u;
+    h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;
+    h = (h >> 22u) ^ h;
+    return (h % 1000u) / 1000.0f;
+}
+
+// Cull parameters of one layer, std430 layout of CullLayer in src/shaders/foliage/cull.comp
+struct FoliageCullLayer
+{
+    uint32_t firstInstance; // into the culled instance buffer
+    uint32_t instanceCount;
+    float boundingRadius;
+    float farDistance;
+    float crossFade;
+    float lodToIndex;
+    float lodDensity[FoliageDensityLUT::SIZE + 1];
+};
+
+// How instances are distributed over the layer's density map
+enum class FoliageSampling
+{
+    POISSON_DISK, // blue noise with minimum spacing, count is an upper bound
+    IMPORTANCE    // alias-table sampling, exactly `count` instances
+};
+
+// Placement parameters - the same seed always produces the same meadow
+struct FoliagePlacement
+{
+    uint32_t seed = 1337;
+    FoliageSampling sampling = FoliageSampling::POISSON_DISK;
+    float minSpacing = 0.0f; // Poisson-disk spacing in metres, 0 = derive from the requested count
+    vector<ExclusionZone> exclusions;
+    bool useDiskCache = true; // reuse placements from cache/ when the inputs match
+};
+
+// Data-driven foliage kind (ferns, mushrooms, clover...), rendered through FoliageBatch
+struct FoliageLayerDesc
+{
+    string name;
+    vector<string> textures; // one texture-array slice each, picked at random per instance
+    int count = 1000;
+    float height = 1.0f;
+    float width = 1.0f;
+    float boundingRadius = 0.7f;
+    float minNormalY = 0.6f;        // placement slope limit
+    float ultraNearDistance = 0.0f; // 100% density carpet inside this, 0 = none
+    LODConfig lod;
+    FoliagePlacement placement;
+};
+
+// Per-instance vertex data layout
+enum class FoliageInstanceFormat
+{
+    FULL,  // vec3 position (+ float texture index in its own buffer), 12-16 bytes
+    PACKED // PackedFoliageInstance, 8 bytes
+};
+
+// Compact instance: XZ quantised to the layer bounds, half-float height,
+// variant (texture index) and a random rank, converted by the vertex fetch
+struct PackedFoliageInstance
+{
+    uint16_t x, z; // unorm16 across instanceOrigin .. instanceOrigin + instanceExtent
+    uint16_t y;    // IEEE half
+    uint8_t variant;
+    uint8_t rank;
+};
+static_assert(sizeof(PackedFoliageInstance) == 8, "packed foliage instance must stay 8 bytes");
+
+// Spatial bucket of instances; positions are sorted so each cell is a contiguous range
+struct FoliageCell
+{
+    glm::vec3 center; // bounding sphere of the cell's instances
+    float radius;
+    uint32_t begin;
+    uint32_t end;
 };
 
 class Foliage
@@ -22,7 +104,12 @@ class Foliage
 public:
     // Constructor
     Foliage(Terrain *terrain, FoliageType type, int count, float height, float width,
-            const LODConfig &lodConfig = LODConfig());
+            const LODConfig &lodConfig = LODConfig(),
+            const FoliagePlacement &placement = FoliagePlacement());
+
+    // Data-driven layer whose texture indices start at firstSlice. It has no
+    // geometry or instance buffers of its own, FoliageBatch draws it
+    Foliage(Terrain *terrain, const FoliageLayerDesc &layer, int firstSlice);
 
     // Destructor
     ~Foliage();
@@ -31,19 +118,81 @@ public:
     void Draw(Shader &shader, const glm::mat4 &view, const glm::mat4 &projection,
               const Camera::Frustum &frustum, const Camera &camera);
 
+    // Switch to compute-shader culling (GL 4.3+), returns false and keeps the CPU path otherwise.
+    // Batched layers are culled by their FoliageBatch instead
+    bool EnableGPUCulling(const char *computePath);
+    bool IsGPUCulling() const { return gpuCulling; }
+
+    // Batched culling into buffers shared with other layers: append (position, slice)
+    // survivors and their dither on the CPU
+    void CullInto(const Camera::Frustum &frustum, const Camera &camera,
+                  vector<glm::vec4> &out, vector<uint8_t> &outDither);
+
+    // Batched compute culling: every (position, slice) this layer placed, and its entry
+    // in the batch's CullLayers buffer for this projection
+    void AppendCullInstances(vector<glm::vec4> &out) const;
+    FoliageCullLayer CullLayer(const Camera::Frustum &frustum, uint32_t firstInstance);
+
+    // Switch the instance layout uploaded to the GPU (FULL is kept for A/B comparisons)
+    void SetInstanceFormat(FoliageInstanceFormat format);
+    FoliageInstanceFormat GetInstanceFormat() const { return instanceFormat; }
+
+    // Order of the visible instances after CPU culling (front-to-back by default,
+    // these are alpha-tested); the compute path keeps its atomic append order
+    void SetDepthOrder(DepthOrder order)
+    {
+        depthOrder = order;
+        visibilityValid = false;
+    }
+    DepthOrder GetDepthOrder() const { return depthOrder; }
+    float GetSortMs() const { return depthSorter.GetLastSortMs(); }
+
+    // Draw with a depth prepass using these programs instead of the one passed to
+    // Draw (uniforms set by the caller on both); empty shaders switch it off
+    void SetDepthPrepass(const DepthPrepassShaders &shaders) { prepass = shaders; }
+    bool UsesDepthPrepass() const { return prepass.Enabled(); }
+
+    // Placement density as a GL_R8 texture over the terrain, one texel per quad
+    // (terrain.frag uses the grass one for far-field shading); caller owns it
+    unsigned int CreateDensityTexture() const;
+
     // get visible grass count
-    int GetVisibleCount() const { return visiblePositions.size(); }
+    int GetVisibleCount() const { return visibleCount; } // GPU culling: as of a frame or two ago
+
+    // Temporal coherence: frames that reused the cached visible set
+    int GetVisibilityReuseCount() const { return visibilityReuseCount; }
+    float GetVisibilityReuseRate() const;
+
+    // Camera movement below which the cached visible set is reused
+    float reusePositionThreshold = 0.02f; // metres
+    float reuseAngleThreshold = 0.99995f; // cosine between view directions (~0.6 degrees)
 
     // Public members
     vector<glm::vec3> positions;
     FoliageType type;
 
 private:
+    // Per-kind constants copied from the traits struct
+    const char *typeName;
+    bool hasTextureIndex;
+    float minNormalY;
+    float ultraNearDistance;
+    int variantCount = 1;
+
+    // Data-driven layer state (type == LAYER)
+    bool batched = false;
+    int firstSlice = 0;
+    string layerName;
+    LayerTraits layerTraits;
+
     Terrain *terrain;
     LODConfig lodConfig;
-    unsigned int VAO, VBO, EBO;
-    unsigned int instanceVBO;
-    unsigned int textureIndexVBO;
+    LODConfig viewLOD; // lodConfig for the projection being culled (projected-size LOD)
+    FoliagePlacement placement;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int instanceVBO = 0;
+    unsigned int textureIndexVBO = 0;
+    unsigned int ditherVBO = 0; // per visible instance, unorm8 cross-fade dissolve
 
     int count;
     float height;
@@ -52,10 +201,79 @@ private:
     float terrainHeightScale; // store max terrain height for placement
 
     vector<glm::vec3> visiblePositions;
+    vector<uint8_t> visibleMask; // scratch for the culling kernels
+    vector<uint8_t> ditherScratch;
     std::vector<float> textureIndices;
     std::vector<float> visibleTextureIndices;
+    vector<uint8_t> visibleDither;
+    vector<float> visibleDepths; // view depth per survivor, for the depth sort
+
+    // Depth-sorted submission
+    DepthOrder depthOrder = DepthOrder::FRONT_TO_BACK;
+    DepthSorter depthSorter;
+    int visibleCount = 0;
+
+    DepthPrepassShaders prepass;
+
+    // Packed instance format (same order as positions)
+    FoliageInstanceFormat instanceFormat = FoliageInstanceFormat::FULL;
+    vector<PackedFoliageInstance> packedInstances;
+    vector<PackedFoliageInstance> visiblePackedInstances;
+    glm::vec2 instanceOrigin = glm::vec2(0.0f); // XZ quantisation bounds
+    glm::vec2 instanceExtent = glm::vec2(1.0f);
+
+    // Spatial cells, and a hierarchy over them for the CPU cull
+    float cellSize = 8.0f;
+    vector<FoliageCell> cells;
+    CullingBVH cellBVH;
+    vector<uint32_t> candidateCells;
+    vector<uint8_t> candidateCellInside;
+
+    // Visible set cache and the camera pose it was computed for
+    bool visibilityValid = false;
+    glm::vec3 cachedCameraPos;
+    glm::vec3 cachedCameraFront;
+    Camera::Frustum cachedFrustum; // projection (zoom, aspect, resolution) of the cached set
+    int visibilityFrameCount = 0;
+    int visibilityReuseCount = 0;
+
+    // GPU culling (compute shader + indirect draw)
+    bool gpuCulling = false;
+    Shader *cullShader = nullptr;
+    unsigned int gpuVAO = 0;
+    unsigned int allInstanceSSBO = 0;     // every placed instance, uploaded once
+    unsigned int cullLayerSSBO = 0;       // the one FoliageCullLayer
+    unsigned int visibleInstanceSSBO = 0; // compacted survivors
+    unsigned int visibleDitherSSBO = 0;   // float dissolve per survivor
+    unsigned int indirectBuffer = 0;      // DrawElementsIndirectCommand
+    CounterReadback visibleReadback;      // its instanceCount, a frame late
 
     // Setup methods
+    void init();
     void generatePositions();
+    DensityRules densityRules() const;
+    FoliageDensityLUT densityLUT() const;
     void setupCrossQuad();
+    void bindQuadGeometry();
+    void bindInstanceAttributes(bool compacted);
+    void packInstances();
+    void uploadCullInstances();
+    void buildCells();
+    void placeInstances();
+
+    // Binary instance cache (see foliage_cache.h)
+    uint64_t cacheKey() const;
+    bool loadFromCache(const string &path, uint64_t key);
+    void saveToCache(const string &path, uint64_t key) const;
+
+    // Culling and submission paths
+    bool isCameraStill(const Camera &camera, const Camera::Frustum &frustum) const;
+    void cullCPU(const Camera::Frustum &frustum, const Camera &camera);
+    void runCullKernel(const Camera::Frustum &frustum, const Camera &camera);
+    template <typename Traits>
+    void cullKernel(const Traits &traits, const Camera::Frustum &frustum, const Camera &camera);
+    void cullGPU(const Camera::Frustum &frustum, const Camera &camera);
+    void submit(Shader &shader);
+    void submitCPU();
+    void submitGPU();
 };
\ No newline at end of file
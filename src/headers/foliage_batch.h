@@ -0,0 +1,108 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "shader.h"
+#include "terrain.h"
+#include "camera.h"
+#include "foliage.h"
+#include "depth_sort.h"
+#include "depth_prepass.h"
+#include "counter_readback.h"
+
+// Texture-array slices a batch can address, must match MAX_SLICES in src/shaders/foliage/layer.vert
+const int MAX_FOLIAGE_SLICES = 32;
+
+// Data-driven foliage layers sharing one shader, one GL_TEXTURE_2D_ARRAY and one
+// instance stream, so the whole batch is a single instanced (or indirect) draw
+// no matter how many layers it holds
+class FoliageBatch
+{
+public:
+    FoliageBatch(Terrain *terrain, const vector<FoliageLayerDesc> &layerDescs);
+    ~FoliageBatch();
+
+    // Cull every layer, then one draw call for all of them
+    void Draw(Shader &shader, const Camera::Frustum &frustum, const Camera &camera);
+
+    // Compute-shader culling into a shared output (GL 4.3+), false keeps the CPU path
+    bool EnableGPUCulling(const char *computePath);
+    bool IsGPUCulling() const { return gpuCulling; }
+
+    int GetLayerCount() const { return static_cast<int>(layers.size()); }
+    int GetVisibleCount() const { return visibleCount; } // GPU culling: as of a frame or two ago
+
+    // Layers are alpha-blended, so CPU-culled survivors are drawn back-to-front by default
+    void SetDepthOrder(DepthOrder order)
+    {
+        depthOrder = order;
+        visibilityValid = false;
+    }
+    float GetSortMs() const { return depthSorter.GetLastSortMs(); }
+
+    // Depth prepass for the whole batch (every layer shares the one draw), see Foliage
+    void SetDepthPrepass(const DepthPrepassShaders &shaders) { prepass = shaders; }
+
+    // Alpha-tested depth only (a DEPTH_PREPASS_DEPTH_ONLY program), no colour. With
+    // order-independent layers this puts their opaque part in the depth buffer, so
+    // what is drawn later (and occlusion queries) is hidden behind it
+    void DrawDepth(Shader &depthShader, const Camera::Frustum &frustum, const Camera &camera);
+
+    // Camera movement below which the cached visible set is reused (same as Foliage)
+    float reusePositionThreshold = 0.02f;
+    float reuseAngleThreshold = 0.99995f;
+
+private:
+    vector<Foliage *> layers;
+    vector<string> slicePaths;     // texture per slice
+    vector<glm::vec2> sliceSizes;  // billboard width, height per slice
+    size_t instanceTotal = 0;
+
+    unsigned int textureArray = 0; // owned by TextureCache
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int instanceVBO = 0;
+    unsigned int ditherVBO = 0;
+    vector<unsigned int> sizesUploadedTo; // programs that already have sliceSize[]
+
+    // xyz = position, w = texture-array slice
+    vector<glm::vec4> visibleInstances;
+    vector<uint8_t> visibleDither; // unorm8 cross-fade dissolve per visible instance
+    int visibleCount = 0;
+
+    DepthOrder depthOrder = DepthOrder::BACK_TO_FRONT;
+    DepthSorter depthSorter;
+    vector<float> visibleDepths;
+
+    DepthPrepassShaders prepass;
+
+    // Visible set cache
+    bool visibilityValid = false;
+    glm::vec3 cachedCameraPos;
+    glm::vec3 cachedCameraFront;
+    Camera::Frustum cachedFrustum; // projection (zoom, aspect, resolution) of the cached set
+
+    // GPU culling
+    bool gpuCulling = false;
+    Shader *cullShader = nullptr;     // one program for every layer
+    unsigned int gpuVAO = 0;
+    unsigned int allInstanceSSBO = 0; // every layer's instances back to back, uploaded once
+    unsigned int cullLayerSSBO = 0;   // FoliageCullLayer per layer
+    vector<FoliageCullLayer> cullLayers;
+    unsigned int visibleInstanceSSBO = 0;
+    unsigned int visibleDitherSSBO = 0;
+    unsigned int indirectBuffer = 0;
+    CounterReadback visibleReadback; // instanceCount of the indirect command, a frame late
+
+    void setupQuad();
+    void bindQuadGeometry();
+    void bindInstanceAttributes(unsigned int buffer, unsigned int ditherBuffer, bool floatDither);
+    bool isCameraStill(const Camera &camera, const Camera::Frustum &frustum) const;
+    void updateVisibility(const Camera::Frustum &frustum, const Camera &camera);
+    void cullCPU(const Camera::Frustum &frustum, const Camera &camera);
+    void cullGPU(const Camera::Frustum &frustum, const Camera &camera);
+    void submit(Shader &shader);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "foliage.h"
+
+// Everything a foliage layer needs to skip placement on the next launch
+struct FoliageCacheData
+{
+    uint32_t seed = 0;
+    vector<glm::vec3> positions; // already sorted into cells
+    vector<float> textureIndices;
+    vector<FoliageCell> cells;
+};
+
+// 64-bit FNV-1a over the inputs that determine a layer's placement
+struct CacheKeyBuilder
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    void Add(const void *bytes, size_t size)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(bytes);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    template <typename T>
+    void Add(const T &value) { Add(&value, sizeof(T)); }
+};
+
+// Versioned binary cache of placed foliage instances, memory-mapped on load
+class FoliageCache
+{
+public:
+    // Bump whenever placement or the file layout changes
+    static const uint32_t VERSION = 1;
+
+    static string GetPath(const string &layerName, uint64_t key);
+    static bool Load(const string &path, uint64_t key, FoliageCacheData &data);
+    static bool Save(const string &path, uint64_t key, const FoliageCacheData &data);
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+#include "shader.h"
+#include "terrain.h"
+#include "camera.h"
+#include "lod.h"
+#include "foliage.h"
+#include "density_map.h"
+#include "depth_sort.h"
+#include "depth_prepass.h"
+
+struct FoliageStreamSettings
+{
+    float cellSize = 16.0f;        // metres per streamed cell
+    float activationRadius = 0.0f; // cells nearer than this get generated, 0 = LOD far distance + one cell
+    float evictionRadius = 0.0f;   // resident cells past this are dropped, 0 = 1.25 x activation
+    int workerCount = 0;           // generation threads, 0 = one less than the hardware threads
+};
+
+// Foliage generated lazily per cell around the camera. Worker threads place a cell's
+// instances when the camera comes within its activation radius; cells well outside
+// it are evicted and their range of the instance buffer is handed to the next cell.
+// Memory is bounded by view distance instead of terrain size
+class FoliageStream
+{
+public:
+    // count is the whole-terrain equivalent, so density matches a non-streamed Foliage
+    FoliageStream(Terrain *terrain, FoliageType type, int count, float height, float width,
+                  const LODConfig &lodConfig = LODConfig(),
+                  const FoliagePlacement &placement = FoliagePlacement(),
+                  const FoliageStreamSettings &settings = FoliageStreamSettings());
+    ~FoliageStream();
+
+    // Streams cells around the camera, then one instanced draw per visible resident cell
+    void Draw(Shader &shader, const Camera::Frustum &frustum, const Camera &camera);
+
+    // Placement density as a GL_R8 texture over the terrain, caller owns it
+    unsigned int CreateDensityTexture() const { return densityMap.CreateTexture(); }
+
+    int GetResidentCellCount() const { return static_cast<int>(resident.size()); }
+    int GetPendingCellCount() const { return static_cast<int>(pending.size()); }
+    size_t GetResidentInstanceCount() const { return residentInstanceCount; }
+    int GetVisibleCount() const { return visibleCount; }
+
+    // Order of the per-cell draws, front-to-back by default
+    void SetDepthOrder(DepthOrder order) { depthOrder = order; }
+
+    // Depth prepass programs used instead of the shader passed to Draw, see Foliage
+    void SetDepthPrepass(const DepthPrepassShaders &shaders) { prepass = shaders; }
+
+private:
+    // Output of a worker, uploaded by the GL thread
+    struct CellResult
+    {
+        int cell;
+        vector<glm::vec3> positions;
+        vector<float> textureIndices;
+        glm::vec3 center;
+        float radius;
+    };
+
+    // Cell whose instances live in one slot of the instance buffers
+    struct ResidentCell
+    {
+        int slot;
+        uint32_t count;
+        glm::vec3 center;
+        float radius;
+    };
+
+    Terrain *terrain;
+    FoliageType type;
+    LODConfig lodConfig;
+    FoliagePlacement placement;
+    FoliageStreamSettings settings;
+    DensityMap densityMap;
+
+    // Per-kind constants copied from the traits struct
+    const char *typeName;
+    float boundingRadius;
+    bool hasTextureIndex;
+    int variantCount = 1;
+
+    float height;
+    float width;
+    float spacing;    // Poisson-disk spacing derived from the requested count
+    glm::vec2 gridOrigin;
+    int cellsX, cellsZ;
+
+    // Fixed pool of equally sized slots in the instance buffers
+    int slotCount = 0;
+    uint32_t slotCapacity = 0; // instances per slot
+    vector<int> freeSlots;
+
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int instanceVBO = 0;
+    unsigned int textureIndexVBO = 0;
+
+    // GL-thread state
+    unordered_map<int, ResidentCell> resident;
+    unordered_set<int> pending; // queued or being generated
+    size_t residentInstanceCount = 0;
+    int visibleCount = 0;
+    int evictedCount = 0;
+
+    // Visible resident cell of the current frame
+    struct VisibleCell
+    {
+        const ResidentCell *cell;
+        GLsizei instances;
+    };
+
+    DepthOrder depthOrder = DepthOrder::FRONT_TO_BACK;
+    DepthSorter depthSorter;
+    vector<VisibleCell> visibleCells;
+    vector<float> visibleDepths;
+    DepthPrepassShaders prepass;
+
+    // Shared with the workers, guarded by queueMutex
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<int> jobQueue;
+    vector<CellResult> completed;
+    bool stopping = false;
+    vector<thread> workers;
+
+    void setupQuad();
+    void submit(Shader &shader);
+    void update(const Camera &camera);
+    float cellDistance(int cell, const glm::vec2 &point) const;
+    float densityAt(const LODConfig &lod, float distance) const;
+    void workerLoop();
+    CellResult generateCell(int cell) const;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "lod.h"
+
+enum class FoliageType
+{
+    GRASS,
+    LAYER // data-driven, constants come from a FoliageLayerDesc at runtime
+};
+
+// Compile-time description of a foliage kind.
+// Adding a new kind = a new traits struct + one case in VisitFoliageTraits.
+struct GrassTraits
+{
+    static constexpr const char *name = "grass";
+    static constexpr float boundingRadius = 0.5f;
+    static constexpr float minNormalY = 0.5f;        // placement slope limit
+    static constexpr float ultraNearDistance = 8.0f; // 100% density carpet inside this
+    static constexpr bool hasTextureIndex = false;   // per-instance texture index attribute
+    static constexpr int variantCount = 1;           // textures picked between per instance
+};
+
+// Runtime description of a data-driven layer; the texture index is its texture-array slice
+struct LayerTraits
+{
+    const char *name = "layer";
+    float boundingRadius = 0.7f;
+    float minNormalY = 0.6f;
+    float ultraNearDistance = 0.0f;
+    static constexpr bool hasTextureIndex = true;
+};
+
+// Banded LOD density, written with selects so culling loops vectorise
+inline float FoliageBandDensity(const LODConfig &lod, float distance)
+{
+    return distance < lod.nearDistance  ? lod.nearDensity
+           : distance < lod.midDistance ? lod.midDensity
+           : distance < lod.farDistance ? lod.farDensity
+                                        : 0.0f;
+}
+
+// Full density inside the carpet, blending to nearDensity at nearDistance
+inline float FoliageCarpetDensity(const LODConfig &lod, float distance, float ultraNearDistance, float density)
+{
+    float t = glm::clamp((distance - ultraNearDistance) / (lod.nearDistance - ultraNearDistance), 0.0f, 1.0f);
+    float carpet = glm::mix(1.0f, lod.nearDensity, t);
+    return distance < lod.nearDistance ? carpet : density;
+}
+
+// LOD density curve for a foliage kind, the carpet is compiled out where unused
+template <typename Traits>
+inline float FoliageDensity(const Traits &, const LODConfig &lod, float distance)
+{
+    float density = FoliageBandDensity(lod, distance);
+    if constexpr (Traits::ultraNearDistance > 0.0f)
+        density = FoliageCarpetDensity(lod, distance, Traits::ultraNearDistance, density);
+    return density * lod.GetFadeFactor(distance);
+}
+
+// Data-driven layers decide at runtime (the branch is loop-invariant)
+inline float FoliageDensity(const LayerTraits &traits, const LODConfig &lod, float distance)
+{
+    float density = FoliageBandDensity(lod, distance);
+    if (traits.ultraNearDistance > 0.0f)
+        density = FoliageCarpetDensity(lod, distance, traits.ultraNearDistance, density);
+    return density * lod.GetFadeFactor(distance);
+}
+
+// Density curve sampled into a table once per frame/config, so per-instance evaluation
+// is a lerp between two entries instead of the band/carpet/fade branches. Linear
+// filtering also turns each band edge into a short ramp. The GPU passes get the same
+// table as a uniform array (lodDensity[] in cull.comp and grass_procedural.vert)
+struct FoliageDensityLUT
+{
+    static constexpr int SIZE = 64; // intervals between 0 and farDistance, must match LOD_LUT_SIZE in the shaders
+    float values[SIZE + 1];
+    float toIndex; // distance -> table position
+
+    float Sample(float distance) const
+    {
+        float x = glm::clamp(distance * toIndex, 0.0f, (float)SIZE);
+        int i = glm::min((int)x, SIZE - 1);
+        return glm::mix(values[i], values[i + 1], x - (float)i);
+    }
+};
+
+template <typename Traits>
+inline FoliageDensityLUT BuildFoliageDensityLUT(const Traits &traits, const LODConfig &lod)
+{
+    FoliageDensityLUT lut;
+    float farDistance = glm::max(lod.farDistance, 0.001f);
+    lut.toIndex = FoliageDensityLUT::SIZE / farDistance;
+    for (int i = 0; i <= FoliageDensityLUT::SIZE; i++)
+        lut.values[i] = FoliageDensity(traits, lod, farDistance * i / FoliageDensityLUT::SIZE);
+    return lut;
+}
+
+// Dissolve amount for an instance of this rank: 0 = solid, 1 = gone. Instances
+// are visible while it is below 1
+inline float FoliageDither(float density, float rank, float crossFade)
+{
+    return 1.0f - glm::clamp((density - rank) / glm::max(crossFade, 0.0001f), 0.0f, 1.0f);
+}
+
+// The single runtime switch from FoliageType to its traits (LAYER has no static traits)
+template <typename Fn>
+inline void VisitFoliageTraits(FoliageType type, Fn &&fn)
+{
+    switch (type)
+    {
+    case FoliageType::GRASS:
+        fn(GrassTraits{});
+        break;
+    case FoliageType::LAYER:
+        break;
+    }
+}
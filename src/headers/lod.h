@@ -1,6 +1,8 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cfloat>
+#include <cmath>
 
 // to manage the LOD (Level-Of-Distance)
 struct LODConfig
@@ -15,30 +17,119 @@ struct LODConfig
     float midDensity = 0.5f;  // 50% instances
     float farDensity = 0.2f;  // 20% instances
 
+    // Density ramps linearly to 0 over this band ending at farDistance (0 = hard cut)
+    float fadeBand = 0.0f;
+
+    // Level changes are delayed until the distance is this far past a band edge,
+    // so objects sitting on an edge don't flicker between levels
+    float hysteresis = 0.0f;
+
+    // Instances whose density rank is within this much of the threshold are drawn
+    // partially dissolved (screen-door dither) instead of popping (0 = hard cut)
+    float crossFade = 0.0f;
+
+    // Optional projected-size LOD: the distances above are tuned for the reference
+    // projection and rescaled by ForProjection() so each band keeps its on-screen
+    // size under the current FOV and resolution; anything smaller than minPixelSize
+    // is dropped
+    bool screenSpace = false;
+    float referenceFovY = 75.0f;             // degrees
+    float referenceViewportHeight = 1200.0f; // pixels
+    float minPixelSize = 1.0f;               // projected diameter in pixels
+
+    // Pixels covered by 1m seen from 1m away, set by ForProjection (0 = world distances)
+    float pixelScale = 0.0f;
+
+    static float PixelScale(float fovY, float viewportHeight)
+    {
+        return viewportHeight * 0.5f / tanf(fovY * 0.5f);
+    }
+
+    // Projected diameter in pixels of a sphere at this distance
+    float GetProjectedSize(float radius, float distance) const
+    {
+        return 2.0f * radius * pixelScale / glm::max(distance, 0.0001f);
+    }
+
+    // Distance past which a sphere of this radius is smaller than minPixelSize
+    float GetScreenCutoff(float radius) const
+    {
+        if (pixelScale <= 0.0f || radius <= 0.0f)
+            return FLT_MAX;
+        return 2.0f * radius * pixelScale / glm::max(minPixelSize, 0.0001f);
+    }
+
+    // Copy with the bands rescaled for a projection (fovY in radians). Projected size
+    // is proportional to pixelScale / distance, so scaling every distance by the ratio
+    // of pixel scales keeps it constant. With an objectRadius the far band also ends
+    // where that object falls below minPixelSize
+    LODConfig ForProjection(float fovY, float viewportHeight, float objectRadius = 0.0f) const
+    {
+        if (!screenSpace || fovY <= 0.0f || viewportHeight <= 0.0f)
+            return *this;
+
+        LODConfig scaled = *this;
+        scaled.pixelScale = PixelScale(fovY, viewportHeight);
+        float scale = scaled.pixelScale / PixelScale(glm::radians(referenceFovY), referenceViewportHeight);
+        scaled.nearDistance *= scale;
+        scaled.midDistance *= scale;
+        scaled.farDistance *= scale;
+        scaled.fadeBand *= scale;
+
+        float cutoff = scaled.GetScreenCutoff(objectRadius);
+        if (cutoff < scaled.farDistance)
+        {
+            scaled.farDistance = cutoff;
+            scaled.midDistance = glm::min(scaled.midDistance, cutoff);
+            scaled.nearDistance = glm::min(scaled.nearDistance, cutoff);
+            scaled.fadeBand = glm::min(scaled.fadeBand, cutoff);
+        }
+        return scaled;
+    }
+
     // Calculate LOD level for a position
     int GetLODLevel(const glm::vec3 &position, const glm::vec3 &cameraPos) const
     {
-        float dist = glm::distance(position, cameraPos);
+        return GetLODLevel(glm::distance(position, cameraPos));
+    }
 
-        if (dist < nearDistance)
-            return 0; // Near (full detail)
-        else if (dist < midDistance)
-            return 1; // Mid
-        else if (dist < farDistance)
-            return 2; // Far
-        else
-            return 3; // Culled
+    // 0 = near (full detail), 1 = mid, 2 = far, 3 = culled
+    int GetLODLevel(float distance) const
+    {
+        return (distance >= nearDistance) + (distance >= midDistance) + (distance >= farDistance);
+    }
+
+    // Level with hysteresis: previousLevel is kept until the distance leaves its band
+    // by more than `hysteresis` (previousLevel < 0 = no history). The cull edge at
+    // farDistance is exempt, the fade band already hides it and a sticky cull would
+    // pop objects back in well inside the band
+    int GetLODLevel(float distance, int previousLevel) const
+    {
+        int level = GetLODLevel(distance);
+        if (previousLevel < 0 || previousLevel > 2 || level > 2)
+            return level;
+
+        const float edges[5] = {-FLT_MAX, nearDistance, midDistance, farDistance, FLT_MAX};
+        bool inside = distance >= edges[previousLevel] - hysteresis &&
+                      distance < edges[previousLevel + 1] + hysteresis;
+        return inside ? previousLevel : level;
+    }
+
+    // Fraction of instances kept by the fade band, 1 before it and 0 past farDistance
+    float GetFadeFactor(float distance) const
+    {
+        return glm::clamp((farDistance - distance) / glm::max(fadeBand, 0.0001f), 0.0f, 1.0f);
     }
 
     // Get density multiplier for distance
     float GetDensityMultiplier(float distance) const
     {
         if (distance < nearDistance)
-            return nearDensity;
+            return nearDensity * GetFadeFactor(distance);
         else if (distance < midDistance)
-            return midDensity;
+            return midDensity * GetFadeFactor(distance);
         else if (distance < farDistance)
-            return farDensity;
+            return farDensity * GetFadeFactor(distance);
         else
             return 0.0f; // Cull
     }
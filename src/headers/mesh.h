@@ -4,11 +4,13 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
 
 #include "shader.h"
+#include "mesh_simplify.h"
 
 #define MAX_BONE_INFLUENCE 4
 
@@ -57,8 +59,51 @@ public:
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // builds simplified index buffers (see mesh_simplify.h), one per ratio, stored
+    // after the full indices in the same EBO so they share VAO and vertex data
+    void GenerateLODs(const vector<float> &ratios)
+    {
+        vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (const auto &vertex : vertices)
+            positions.push_back(vertex.Position);
+
+        SetLODs(SimplifyMesh(positions, indices, ratios));
+    }
+
+    // coarser index buffers over the same vertices made elsewhere (e.g. TreeGenerator),
+    // stored the same way as GenerateLODs does
+    void SetLODs(const vector<vector<unsigned int>> &lods)
+    {
+        vector<unsigned int> allIndices(indices);
+        lodOffsets.assign(1, 0);
+        lodCounts.assign(1, (GLsizei)indices.size());
+        for (const auto &lod : lods)
+        {
+            lodOffsets.push_back(allIndices.size());
+            lodCounts.push_back((GLsizei)lod.size());
+            allIndices.insert(allIndices.end(), lod.begin(), lod.end());
+        }
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, allIndices.size() * sizeof(unsigned int), &allIndices[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+    }
+
+    // lod 0 is the loaded mesh, higher ones come from GenerateLODs
+    int GetLODCount() const { return lodCounts.empty() ? 1 : (int)lodCounts.size(); }
+    size_t GetTriangleCount(int lod = 0) const
+    {
+        if (lodCounts.empty())
+            return indices.size() / 3;
+        return lodCounts[min(lod, (int)lodCounts.size() - 1)] / 3;
+    }
+
+    // render the mesh; instanceCount > 1 draws it instanced, per-instance attributes
+    // must then be set up on VAO by the caller (locations 7+ are free).
+    // lod past the last generated level draws the coarsest one
+    void Draw(Shader &shader, GLsizei instanceCount = 1, int lod = 0)
     {
         // bind appropriate textures
         unsigned int diffuseNr = 1;
@@ -87,8 +132,19 @@ public:
         }
 
         // draw mesh
+        GLsizei count = static_cast<GLsizei>(indices.size());
+        const void *offset = 0;
+        if (!lodCounts.empty())
+        {
+            lod = max(0, min(lod, (int)lodCounts.size() - 1));
+            count = lodCounts[lod];
+            offset = (const void *)(lodOffsets[lod] * sizeof(unsigned int));
+        }
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        if (instanceCount == 1)
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset);
+        else
+            glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset, instanceCount);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
@@ -98,6 +154,9 @@ public:
 private:
     // render data
     unsigned int VBO, EBO;
+    // index range of each LOD in EBO, empty until GenerateLODs
+    vector<size_t> lodOffsets;
+    vector<GLsizei> lodCounts;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -143,4 +202,4 @@ private:
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, m_Weights));
         glBindVertexArray(0);
     }
-};
\ No newline at end of file
+};
\ No newline at end of file
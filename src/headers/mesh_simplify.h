@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+using namespace std;
+
+// Quadric error metric edge-collapse simplification (Garland & Heckbert). Vertices
+// sharing a position are welded so the surface collapses as one piece; the input
+// vertices at a welded position are its attribute wedges (sides of a UV/normal seam).
+// Every collapse moves one vertex onto the other end of the edge and each corner onto
+// the vertex of its own wedge there, so seams only collapse along themselves. Each
+// simplified index buffer only references the input vertices, and all LODs of a mesh
+// can share its vertex buffer.
+//
+// ratios: fraction of the input triangles each LOD keeps, in descending order. One
+// index buffer is returned per ratio; open borders, seams and triangle flips hold
+// some meshes above the requested count.
+vector<vector<unsigned int>> SimplifyMesh(const vector<glm::vec3> &positions,
+                                          const vector<unsigned int> &indices,
+                                          const vector<float> &ratios);
@@ -37,11 +37,36 @@ public:
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // constructor for meshes built in code (procedural geometry), no file or textures
+    explicit Model(const vector<Mesh> &builtMeshes) : meshes(builtMeshes), gammaCorrection(false)
     {
+    }
+
+    // draws the model, and thus all its meshes (instanceCount copies at the given LOD, see Mesh::Draw)
+    void Draw(Shader &shader, GLsizei instanceCount = 1, int lod = 0)
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw(shader, instanceCount, lod);
+    }
+
+    // simplified LODs for every mesh, ratios as in Mesh::GenerateLODs
+    void GenerateLODs(const vector<float> &ratios)
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].GenerateLODs(ratios);
+    }
+
+    int GetLODCount() const
+    {
+        return meshes.empty() ? 1 : meshes[0].GetLODCount();
+    }
+
+    size_t GetTriangleCount(int lod = 0) const
+    {
+        size_t count = 0;
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            count += meshes[i].GetTriangleCount(lod);
+        return count;
     }
 
 private:
@@ -238,4 +263,4 @@ inline unsigned int TextureFromFile(const char *path, const string &directory, b
     }
 
     return textureID;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Runs job(i) for i in [0, count) on every hardware thread, the calling thread
+// included. Indices are handed out one at a time, so uneven jobs balance out
+template <typename Job>
+void ParallelFor(size_t count, const Job &job)
+{
+    unsigned int threadCount = max(1u, thread::hardware_concurrency());
+
+    atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+            job(i);
+    };
+
+    vector<thread> workers;
+    for (unsigned int i = 1; i < min<size_t>(threadCount, count); i++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+        w.join();
+}
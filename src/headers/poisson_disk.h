@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+using namespace std;
+
+// Small PCG32 generator - unlike <random> distributions its output is
+// identical on every compiler/standard library, so placement is reproducible
+struct PlacementRng
+{
+    uint64_t state;
+
+    explicit PlacementRng(uint64_t seed)
+        : state(seed * 6364136223846793005ULL + 1442695040888963407ULL) {}
+
+    uint32_t NextUInt()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+    }
+
+    // Uniform float in [0, 1)
+    float NextFloat() { return (NextUInt() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// Mix a value into a seed (for per-tile / per-layer seeds)
+inline uint32_t HashCombine(uint32_t seed, uint32_t value)
+{
+    seed ^= value + 0x9e3779b9u + (seed << 6) + (seed >> 2);
+    return seed;
+}
+
+struct PoissonDiskSettings
+{
+    glm::vec2 minCorner;     // XZ bounds of the placement area
+    glm::vec2 maxCorner;
+    float minSpacing = 1.0f; // no two samples closer than this
+    uint32_t seed = 0;
+    int attemptsPerCell = 4; // dart throws per background grid cell
+    int tileCells = 32;      // tile edge in grid cells, tiles run on worker threads
+};
+
+// Extra acceptance test per sample (e.g. terrain slope), called from worker threads
+using PoissonAcceptFn = function<bool(float x, float z)>;
+
+// Blue-noise (Poisson-disk) samples built on a background grid and generated in
+// parallel tiles. Output is deterministic for a given seed regardless of thread count.
+vector<glm::vec2> GeneratePoissonDisk(const PoissonDiskSettings &settings,
+                                      const PoissonAcceptFn &accept);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "shader.h"
+#include "terrain.h"
+#include "camera.h"
+#include "lod.h"
+#include "density_map.h"
+#include "depth_sort.h"
+#include "depth_prepass.h"
+#include "culling_bvh.h"
+
+struct FoliageDensityLUT;
+
+struct ProceduralGrassSettings
+{
+    float cellSize = 8.0f;        // metres, one draw call per visible cell
+    int bladesPerCell = 4096;     // at full density (64 blades per square metre with 8m cells)
+    float bladeHeight = 0.8f;
+    float bladeWidth = 0.4f;
+    uint32_t seed = 1337;
+    vector<ExclusionZone> exclusions;
+};
+
+// Grass generated entirely in grass_procedural.vert from gl_InstanceID and a per-cell
+// seed: no positions on the CPU, no instance buffer and no per-frame uploads.
+// The CPU only culls cells and picks how many blades each one draws
+class ProceduralGrass
+{
+public:
+    ProceduralGrass(Terrain *terrain, const LODConfig &lodConfig,
+                    const ProceduralGrassSettings &settings = ProceduralGrassSettings());
+    ~ProceduralGrass();
+
+    void Draw(Shader &shader, const Camera::Frustum &frustum, const Camera &camera);
+
+    // Placement density (slope + exclusions), shared with the far-field terrain tint
+    unsigned int GetDensityTexture() const { return densityTexture; }
+
+    int GetVisibleCellCount() const { return visibleCellCount; }
+    int GetSubmittedBladeCount() const { return submittedBladeCount; }
+
+    // Order of the per-cell draws, front-to-back by default (blades are alpha-tested)
+    void SetDepthOrder(DepthOrder order) { depthOrder = order; }
+
+    // Depth prepass programs used instead of the shader passed to Draw, see Foliage
+    void SetDepthPrepass(const DepthPrepassShaders &shaders) { prepass = shaders; }
+
+private:
+    struct Cell
+    {
+        glm::vec2 origin; // min XZ corner
+        glm::vec3 center; // bounding sphere of the cell's blades
+        float radius;
+        uint32_t seed;
+    };
+
+    Terrain *terrain;
+    LODConfig lodConfig;
+    ProceduralGrassSettings settings;
+
+    vector<Cell> cells;
+    CullingBVH cellBVH; // static, built with the cells
+    vector<uint32_t> candidateCells;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int heightTexture = 0;
+    unsigned int densityTexture = 0;
+
+    int visibleCellCount = 0;
+    int submittedBladeCount = 0;
+
+    // Visible cells of the current frame and their blade counts, depth-sorted
+    DepthOrder depthOrder = DepthOrder::FRONT_TO_BACK;
+    DepthSorter depthSorter;
+    vector<uint32_t> visibleCells;
+    vector<int> visibleBlades;
+    vector<float> visibleDepths;
+
+    DepthPrepassShaders prepass;
+
+    void buildCells(const DensityMap &densityMap);
+    void setupQuad();
+    // Per-program uniforms, then one draw per visible cell
+    void submit(Shader &shader, const FoliageDensityLUT &lut, float crossFade);
+};
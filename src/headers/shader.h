@@ -74,13 +74,13 @@ public:
         glDeleteShader(fragment);
     }
 
-    // constructor overload
-    Shader(const char *vertexPath, const char *fragmentPath, bool useLibrary)
+    // constructor overload, fragmentDefines selects a variant of the fragment shader
+    Shader(const char *vertexPath, const char *fragmentPath, bool useLibrary, const char *fragmentDefines = "")
     {
         if (useLibrary)
         {
             std::string vertexCode = ShaderLibrary::LoadShaderWithLibrary(vertexPath);
-            std::string fragmentCode = ShaderLibrary::LoadShaderWithLibrary(fragmentPath);
+            std::string fragmentCode = ShaderLibrary::LoadShaderWithLibrary(fragmentPath, fragmentDefines);
 
             const char *vShaderCode = vertexCode.c_str();
             const char *fShaderCode = fragmentCode.c_str();
@@ -113,6 +113,40 @@ public:
         }
     }
 
+    // compute shader constructor (requires an OpenGL 4.3 context)
+    // ------------------------------------------------------------------------
+    explicit Shader(const char *computePath)
+    {
+        string computeCode;
+        ifstream cShaderFile;
+        cShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
+        try
+        {
+            cShaderFile.open(computePath);
+            stringstream cShaderStream;
+            cShaderStream << cShaderFile.rdbuf();
+            cShaderFile.close();
+            computeCode = cShaderStream.str();
+        }
+        catch (ifstream::failure &e)
+        {
+            cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << endl;
+        }
+        const char *cShaderCode = computeCode.c_str();
+
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+
+        glDeleteShader(compute);
+    }
+
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
@@ -136,6 +170,11 @@ public:
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
     }
     // ------------------------------------------------------------------------
+    void setFloatArray(const string &name, const float *values, int count) const
+    {
+        glUniform1fv(glGetUniformLocation(ID, name.c_str()), count, values);
+    }
+    // ------------------------------------------------------------------------
     void setVec2(const string &name, const glm::vec2 &value) const
     {
         glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
@@ -28,7 +28,8 @@ public:
         return content;
     }
 
-    static string LoadShaderWithLibrary(const char *path)
+    // defines (e.g. "#define DEPTH_ONLY\n") go right after #version, ahead of the library
+    static string LoadShaderWithLibrary(const char *path, const string &defines = "")
     {
         ifstream file(path);
         if (!file.is_open())
@@ -48,6 +49,7 @@ public:
             // Inject library after #version directive
             if (!versionFound && line.find("#version") != string::npos)
             {
+                buffer << defines;
                 buffer << "\n// === NPR Color Library Injected ===\n";
                 buffer << GetNPRColors();
                 buffer << "\n// === End NPR Library ===\n\n";
@@ -35,6 +35,12 @@ public:
     glm::vec3 getNormal(float x, float z);
     void regenerateTerrain(int octaves, float frequency, float amplitude);
 
+    // raw heights, row-major (used to key placement caches)
+    const vector<float> &getHeightMap() const { return heightMap; }
+
+    // heights as a GL_R32F texture, one texel per vertex (linear filtering matches getHeight)
+    unsigned int createHeightTexture() const;
+
 private:
     void generateTerrain();
     void calculateNormals();
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// GL textures shared by everything that asks for the same files: each set of paths is
+// uploaded once and later requests get the same texture. Decoded pixels are dropped
+// once uploaded, unless a batch is open: then each file is decoded once even when it
+// appears in several sets of the batch. The cache owns the textures, callers must not
+// delete them
+class TextureCache
+{
+public:
+    // GL_TEXTURE_2D_ARRAY (RGBA8, mipmapped, clamped) with one slice per path. The first
+    // image that loads fixes the resolution, others are resampled to it; empty or
+    // missing paths give fully transparent slices
+    static unsigned int GetArray(const vector<string> &paths, const char *label = "texture");
+
+    // Keep decoded images between GetArray calls until EndBatch, which frees them
+    static void BeginBatch();
+    static void EndBatch();
+
+    // Delete every cached texture and decoded image, while the GL context is still alive
+    static void Clear();
+
+private:
+    // RGBA8 pixels of one file, empty when it failed to load
+    struct Image
+    {
+        vector<unsigned char> pixels;
+        int width = 0, height = 0;
+    };
+
+    static map<string, unsigned int> textures; // key: paths joined by '\n'
+    static map<string, Image> images;          // key: path, only kept within a batch
+    static bool batchOpen;
+
+    static const Image &decode(const string &path, const char *label);
+    static unsigned int loadArray(const vector<string> &paths, const char *label);
+};
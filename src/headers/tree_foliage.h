@@ -4,10 +4,12 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include <random>
+#include <unordered_map>
 using namespace std;
 
 #include "shader.h"
 #include "model.h"
+#include "tree_generator.h"
 
 struct LeafCluster
 {
@@ -25,34 +27,103 @@ struct LeafInstance
     int textureIndex;       // Which leaf texture (0-3)
 };
 
+// Per-tree data of the instanced draws (attributes 7-11 of the branch and leaf shaders)
+struct TreeDrawInstance
+{
+    glm::mat4 model;
+    float lodDither; // screen-door dissolve for LOD fades, 0 = solid
+};
+
+// Points attributes 7-10 (model columns) and 11 (dither) of the bound VAO at buffer,
+// starting at instance firstInstance (no base instance in GL 3.3)
+void BindTreeInstanceAttributes(unsigned int buffer, GLsizei firstInstance = 0);
+
 class TreeFoliage
 {
 public:
     TreeFoliage(const char *branchModelPath);
+    // Procedural tree: its mesh and LODs as generated, leaf clusters on its anchors
+    TreeFoliage(const GeneratedTree &tree);
     ~TreeFoliage();
 
+    // About clustersPerBranch clusters, one on every Nth branch vertex
     void GenerateLeafClusters(int clustersPerBranch = 8, int leavesPerCluster = 15);
-    void Draw(Shader &leafShader, Shader &branchShader,
-              const glm::mat4 &model, const glm::mat4 &view,
-              const glm::mat4 &projection, const glm::vec3 &cameraPos);
+
+    // One cluster on each leaf anchor of a generated tree (none for loaded models)
+    void GenerateLeafClustersOnAnchors(int leavesPerCluster = 4);
+
+    // This frame's visible trees of this type, in draw order. lods picks the branch
+    // mesh LOD and leaf prefix per instance (empty = all full detail); trees are
+    // regrouped by LOD, coarsest first, which keeps back-to-front order as LOD follows distance.
+    // segments (optional, ids >= 0) splits the trees into groups that can be drawn on
+    // their own; each segment's instances must be contiguous
+    void SetInstances(const vector<TreeDrawInstance> &instances, const vector<int> &lods = {},
+                      const vector<int> &segments = {});
+
+    // Every tree set above (or only one segment), one instanced branch draw per LOD in
+    // use then one leaf draw per LOD
+    void Draw(Shader &leafShader, Shader &branchShader, const glm::mat4 &view,
+              const glm::mat4 &projection, const glm::vec3 &cameraPos, int segment = -1);
+
+    // The two halves of Draw, for passes that treat them differently (depth prepass)
+    void DrawBranches(Shader &branchShader, const glm::mat4 &view,
+                      const glm::mat4 &projection, const glm::vec3 &cameraPos, int segment = -1);
+    void DrawLeaves(Shader &leafShader, const glm::mat4 &view,
+                    const glm::mat4 &projection, const glm::vec3 &cameraPos, int segment = -1);
 
     void LoadLeafTextures(const vector<const char *> &texturePaths);
 
+    // Bounding sphere of branches and leaves in tree space (impostor baking)
+    glm::vec3 GetBoundsCenter() const { return boundsCenter; }
+    float GetBoundsRadius() const { return boundsRadius; }
+
+    // Stats of the instances set above
+    int GetDrawCount() const { return (int)lodRanges.size() * 2; }
+    size_t GetBranchTriangleCount() const;
+    size_t GetLeafCount() const;
+
 private:
     // Branch mesh
     Model *branchModel;
     vector<glm::vec3> branchVertices; // Extract for attachment points
+    vector<glm::vec3> leafAnchors;    // generated trees: attachment points on the twigs
 
     // Leaf data
     vector<LeafCluster> clusters;
     vector<LeafInstance> allLeaves;
-    vector<unsigned int> leafTextures;
+    unsigned int leafTextureArray = 0; // owned by TextureCache
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+
+    // OpenGL buffers: every leaf quad of one tree in a single mesh, drawn once per tree.
+    // Quads are stored most important first, so coarser LODs draw a prefix of them
+    unsigned int leafVAO, leafVBO, leafEBO;
+    GLsizei leafIndexCount = 0;
+
+    // Per-tree instances, shared by the leaf VAO and every branch mesh VAO
+    unsigned int instanceVBO;
+    GLsizei instanceCount = 0;
+    size_t instanceCapacity = 0;
 
-    // OpenGL buffers
-    unsigned int quadVAO, quadVBO, quadEBO;
-    unsigned int instanceVBO; // For leaf instance data
+    // Consecutive instances drawn at one LOD
+    struct LODRange
+    {
+        GLsizei first, count;
+        int lod;
+        int segment;
+    };
+    vector<LODRange> lodRanges;
+    unordered_map<int, pair<size_t, size_t>> segmentRanges; // segment -> its lodRanges
+    vector<TreeDrawInstance> groupedInstances;
 
-    void setupQuadMesh();
+    void setupBranches();
+    void buildLeafClusters(const vector<glm::vec3> &attachPoints, int leavesPerCluster);
+    void setupLeafMesh();
+    void setupInstanceBuffer();
+    void computeBounds(const vector<size_t> &leafOrder); // leaves in vertex-buffer order
+    vector<size_t> orderLeavesByImportance(mt19937 &rng) const;
+    GLsizei leafPrefixCount(int lod) const;
+    bool rangesOf(int segment, size_t &begin, size_t &end) const;
     void extractBranchVertices();
     void transferNormals(const glm::vec3 &clusterCenter, LeafInstance &leaf);
 };
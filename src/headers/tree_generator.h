@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "mesh.h"
+
+// Shape of one procedural tree species; the seed picks the individual. Lengths are in
+// tree space, where the branch OBJ trees are about 5 units tall
+struct TreeSpecies
+{
+    uint32_t seed = 1;
+    int levels = 3;              // branch generations above the trunk
+    float trunkLength = 3.0f;
+    float trunkRadius = 0.14f;
+    int childrenPerBranch = 4;   // one more or less at random
+    float lengthRatio = 0.55f;   // child length / parent length
+    float radiusRatio = 0.6f;    // child base radius / parent radius where it starts
+    float branchAngle = 45.0f;   // degrees away from the parent
+    float childStart = 0.35f;    // children grow from this fraction of the parent to its tip
+    float bend = 0.25f;          // random change of direction per segment
+    float upwardPull = 0.15f;    // per segment towards +Y, negative droops
+    float tipTaper = 0.3f;       // tip radius / base radius of every branch
+    int segments = 5;            // along the trunk, one fewer per level (at least 2)
+    int radialSegments = 6;      // sides of every branch, even so LODs can take every other
+    int leafAnchorsPerTwig = 2;  // cluster anchors along each last-level branch, tip first
+};
+
+struct GeneratedTree
+{
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;      // full detail
+    vector<vector<unsigned int>> lods; // coarser index lists over the same vertices (Mesh::SetLODs)
+    vector<glm::vec3> leafAnchors;     // where leaf clusters attach, for TreeFoliage
+};
+
+// Parametric branching: every branch is a tapered tube bent by noise and pulled up,
+// with children spread around it at a golden-angle azimuth. The three coarser LODs
+// reuse the same rings: every other side, then every other ring with the last level
+// cut down to one span per branch, then every fourth ring with the last two levels
+// cut down so. Leaf anchors stay on a branch at every LOD. Deterministic per seed
+GeneratedTree GenerateTree(const TreeSpecies &species);
+
+// Every species grown on worker threads, result i is species i
+vector<GeneratedTree> GenerateTrees(const vector<TreeSpecies> &species);
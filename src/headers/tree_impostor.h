@@ -0,0 +1,62 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+using namespace std;
+
+#include "shader.h"
+#include "tree_foliage.h"
+
+struct TreeImpostorSettings
+{
+    int framesPerSide = 8;     // hemi-octahedral grid of view directions (8 x 8 = 64 frames)
+    int frameResolution = 128; // pixels per frame, atlas is framesPerSide * this square
+    int frameGutter = 4;       // empty texels around each frame, so mips don't bleed between frames
+};
+
+// Far-LOD stand-in for one TreeFoliage type: the tree is rendered once at startup from
+// a hemi-octahedral set of directions above the horizon into a colour and a depth atlas.
+// At runtime each tree is one quad showing the frame nearest to the view direction,
+// and the depth frame puts the quad's fragments back at the tree's surface.
+// Lighting is baked in (the scene light is fixed), so no normal atlas is kept
+class TreeImpostor
+{
+public:
+    // leafShader/branchShader need their lighting uniforms set already
+    TreeImpostor(TreeFoliage *tree, Shader &leafShader, Shader &branchShader,
+                 const TreeImpostorSettings &settings = TreeImpostorSettings());
+    ~TreeImpostor();
+
+    // This frame's trees drawn as impostors, same instance data as the full trees
+    void SetInstances(const vector<TreeDrawInstance> &instances);
+
+    // One instanced quad draw for every tree set above
+    void Draw(Shader &shader, const glm::mat4 &view, const glm::mat4 &projection,
+              const glm::vec3 &cameraPos);
+
+    GLsizei GetInstanceCount() const { return instanceCount; }
+    int GetDrawCount() const { return instanceCount > 0 ? 1 : 0; }
+
+    // Hemi-octahedral mapping of a direction with y >= 0 to [-1, 1]^2 and back,
+    // mirrored in impostor.vert
+    static glm::vec2 EncodeDirection(const glm::vec3 &direction);
+    static glm::vec3 DecodeDirection(const glm::vec2 &uv);
+
+private:
+    TreeImpostorSettings settings;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+    int gutter = 0; // frameGutter, clamped to the frame size
+
+    unsigned int colourAtlas = 0;
+    unsigned int depthAtlas = 0;
+
+    unsigned int quadVAO = 0, quadVBO = 0, quadEBO = 0;
+    unsigned int instanceVBO = 0;
+    GLsizei instanceCount = 0;
+    size_t instanceCapacity = 0;
+
+    void bake(TreeFoliage *tree, Shader &leafShader, Shader &branchShader);
+    void setupQuad();
+};
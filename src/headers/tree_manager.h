@@ -2,13 +2,20 @@
 
 #include <vector>
 #include <random>
+#include <functional>
 using namespace std;
 
 #include "tree_foliage.h"
+#include "tree_impostor.h"
 #include "terrain.h"
 #include "camera.h"
 #include "shader.h"
 #include "lod.h"
+#include "density_map.h"
+#include "tree_placement.h"
+#include "culling_bvh.h"
+#include "depth_sort.h"
+#include "depth_prepass.h"
 
 struct TreeInstance
 {
@@ -16,7 +23,19 @@ struct TreeInstance
     float scale;
     float rotation;
     bool useThickType;
+    glm::vec3 boundsCenter; // world-space centre of the type's bounds
     float boundingRadius;
+    int lodLevel = -1; // last frame's level, for hysteresis (-1 = not evaluated yet)
+    glm::mat4 model;   // precomputed at placement
+    uint32_t cluster;  // occlusion cluster (TreeManager::clusters)
+};
+
+// Neighbouring trees grouped under one occlusion query box
+struct TreeCluster
+{
+    glm::vec3 min, max;   // around the bounding spheres of its trees
+    unsigned int query = 0;
+    int queryFrame = -1;  // frame the query was last issued, -1 = never
 };
 
 class TreeManager
@@ -25,6 +44,7 @@ public:
     TreeManager(Terrain *terrain, TreeFoliage *normalType, TreeFoliage *thickType,
                 int count, const LODConfig &lodConfig,
                 glm::vec3 exclusionCenter, float exclusionRadius);
+    ~TreeManager();
 
     void Draw(Shader &leafShader, Shader &branchShader,
               const glm::mat4 &view, const glm::mat4 &projection,
@@ -33,6 +53,50 @@ public:
     int GetVisibleCount() const { return visibleCount; }
     int GetTotalCount() const { return trees.size(); }
 
+    // Visible trees last frame's occlusion queries found hidden (their draws were
+    // skipped on the GPU); only counts results that were already available
+    int GetOccludedCount() const { return occludedTreeCount; }
+
+    // Draw order of the visible trees, back-to-front by default (blended leaves)
+    void SetDepthOrder(DepthOrder order) { depthOrder = order; }
+
+    // Leaf programs for a depth prepass, used instead of leafShader (see Foliage)
+    void SetDepthPrepass(const DepthPrepassShaders &shaders) { prepass = shaders; }
+
+    // Order-independent leaves (see WeightedOIT): Draw then only draws branches and
+    // impostors, and DrawTransparent draws the leaves with leafShader (the
+    // WEIGHTED_OIT_ACCUMULATE variant) inside the accumulation pass. Takes precedence
+    // over the depth prepass; nullptr switches back to blended leaves.
+    // With a leafDepthShader (DEPTH_PREPASS_DEPTH_ONLY) Draw also writes the alpha-tested
+    // leaf depth, so canopies hide what is drawn after them and count for the occlusion
+    // queries; leaves behind another leaf's opaque part then no longer blend through it
+    void SetWeightedOIT(Shader *leafShader, Shader *leafDepthShader = nullptr)
+    {
+        oitLeafShader = leafShader;
+        oitLeafDepthShader = leafDepthShader;
+    }
+    void DrawTransparent(const glm::mat4 &view, const glm::mat4 &projection, const Camera &camera);
+
+    // Trees at LOD level fromLevel and beyond are drawn as impostors (one quad each)
+    void SetImpostors(TreeImpostor *normalType, TreeImpostor *thickType, Shader *shader, int fromLevel = 2)
+    {
+        normalImpostor = normalType;
+        thickImpostor = thickType;
+        impostorShader = shader;
+        impostorLevel = fromLevel;
+    }
+
+    // Hardware occlusion culling per tree cluster: each cluster's box is queried against
+    // the depth buffer at the end of the frame, and next frame its draws sit inside
+    // glBeginConditionalRender with that result, so the CPU never waits for it.
+    // boxShader draws the boxes (occlusion_box.vert/frag); nullptr turns it off
+    void SetOcclusionCulling(Shader *boxShader);
+
+    // Query the boxes of the clusters drawn this frame. Call once per frame after Draw
+    // and DrawTransparent, whose draws still wait on last frame's results, with the
+    // default framebuffer bound
+    void IssueOcclusionQueries(const glm::mat4 &view, const glm::mat4 &projection, const Camera &camera);
+
 private:
     Terrain *terrain;
     TreeFoliage *normalTree;
@@ -41,5 +105,53 @@ private:
     vector<TreeInstance> trees;
     int visibleCount;
 
+    // Built once over the placed trees, Draw only visits what it returns
+    CullingBVH treeBVH;
+    vector<uint32_t> candidateTrees;
+    int bvhNodesVisited = 0;
+
+    DepthOrder depthOrder = DepthOrder::BACK_TO_FRONT;
+    DepthSorter depthSorter;
+    vector<uint32_t> visibleTrees;
+    vector<float> visibleDithers;
+    vector<float> visibleDepths;
+    vector<TreeDrawInstance> normalInstances; // visible trees per type, in draw order
+    vector<TreeDrawInstance> thickInstances;
+    vector<int> normalLods; // LOD level of each instance above
+    vector<int> thickLods;
+
+    DepthPrepassShaders prepass;
+    Shader *oitLeafShader = nullptr;
+    Shader *oitLeafDepthShader = nullptr;
+
+    TreeImpostor *normalImpostor = nullptr;
+    TreeImpostor *thickImpostor = nullptr;
+    Shader *impostorShader = nullptr;
+    int impostorLevel = 2;
+    vector<TreeDrawInstance> normalImpostorInstances;
+    vector<TreeDrawInstance> thickImpostorInstances;
+
+    // Occlusion culling (SetOcclusionCulling)
+    float clusterSize = 24.0f; // grid cell the clusters are built from, metres
+    vector<TreeCluster> clusters;
+    Shader *occlusionShader = nullptr;
+    unsigned int boxVAO = 0, boxVBO = 0, boxEBO = 0;
+    int frameIndex = 0;
+    vector<uint32_t> drawnClusters;  // clusters with full trees this frame, in draw order
+    vector<int> clusterTreeCounts;   // visible trees per cluster this frame
+    vector<uint8_t> clusterConditional; // per cluster: draws wait on last frame's query
+    vector<uint32_t> clusterOffsets;
+    vector<uint32_t> groupedTrees;   // scratch for groupByCluster
+    vector<float> groupedDithers;
+    vector<int> normalSegments;      // cluster of each instance above
+    vector<int> thickSegments;
+    int occludedTreeCount = 0;
+    int occludedClusterCount = 0;
+
     void generateTreePositions(int count, glm::vec3 exclusionCenter, float exclusionRadius);
+    void buildClusters();
+    bool occlusionEnabled() const { return occlusionShader && !clusters.empty(); }
+    void forEachCluster(const function<void(int)> &draw);
+    void groupByCluster(bool useImpostors);
+    bool cameraInCluster(const TreeCluster &cluster, const glm::vec3 &cameraPos) const;
 };
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#include "density_map.h"
+
+// Tree types TreeManager places
+enum TreeType
+{
+    TREE_NORMAL = 0,
+    TREE_THICK = 1,
+    TREE_TYPE_COUNT
+};
+
+struct TreePlacementSettings
+{
+    int count = 50;                 // trees wanted, fewer if the terrain fills up first
+    int candidatesPerTree = 3;      // density-map samples drawn per wanted tree
+    uint32_t seed = 42;
+    float spacingRadius[TREE_TYPE_COUNT] = {2.0f, 2.0f}; // two trees stay radiusA + radiusB apart
+    float thickShare = 0.5f;        // chance a tree is TREE_THICK
+    float minScale = 2.0f;
+    float maxScale = 4.0f;
+    int tileCells = 16;             // tile edge in grid cells, tiles run on worker threads
+};
+
+struct TreePlacement
+{
+    glm::vec2 position; // XZ
+    float scale;
+    float rotation;     // degrees around Y
+    TreeType type;
+};
+
+// Candidates are importance-sampled from the density map, then spacing-tested on a
+// uniform grid (cell = largest pair spacing, so only the 3x3 neighbourhood is checked)
+// in parallel tiles like GeneratePoissonDisk. Output is deterministic for a given seed
+// regardless of thread count.
+vector<TreePlacement> PlaceTrees(const DensityMap &densityMap, const TreePlacementSettings &settings);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+// Fragment shader variant of a blended layer that writes the OIT accumulation targets,
+// passed as the defines of Shader(vertexPath, fragmentPath, true, defines)
+#define WEIGHTED_OIT_ACCUMULATE "#define WEIGHTED_OIT\n"
+
+// Weighted blended order-independent transparency (McGuire & Bavoil 2013). Blended
+// layers draw unsorted into two offscreen targets, the accumulated weighted colour
+// (RGB) with the product of (1 - alpha) as revealage (A), and the sum of the weights;
+// one fullscreen pass then composites their weighted average over the opaque scene.
+// The cost is fixed per fragment, nothing is sorted. Uses the GL 3.3 form of the
+// technique: both targets share one blend function
+class WeightedOIT
+{
+public:
+    ~WeightedOIT();
+
+    // Match the default framebuffer, (re)creating the targets when the size changes
+    void Resize(int width, int height);
+
+    // Copy the opaque depth, clear the targets and bind them with accumulation blending,
+    // depth writes off and GL_LEQUAL (a layer's own depth-only pass doesn't hide it).
+    // Everything drawn until Composite is order-independent
+    void BeginAccumulation();
+
+    // Back to the default framebuffer, blend the weighted average over it. Expects
+    // src/shaders/oit/composite.vert/frag
+    void Composite(Shader &compositeShader);
+
+private:
+    unsigned int framebuffer = 0;
+    unsigned int accumTexture = 0;  // RGBA16F: sum of colour * alpha * weight, A = revealage
+    unsigned int weightTexture = 0; // R16F: sum of alpha * weight
+    unsigned int depthBuffer = 0;   // copy of the opaque depth, tested but not written
+    unsigned int emptyVAO = 0;      // the composite triangle comes from gl_VertexID
+    int width = 0, height = 0;
+
+    void release();
+};
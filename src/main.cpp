@@ -15,10 +15,18 @@ using namespace std;
 #include "fairy.h"
 #include "firefly.h"
 #include "foliage.h"
+#include "foliage_batch.h"
+#include "procedural_grass.h"
+#include "foliage_stream.h"
+#include "depth_prepass.h"
 #include "texture_generator.h"
 #include "model.h"
 #include "tree_foliage.h"
 #include "tree_manager.h"
+#include "tree_impostor.h"
+#include "tree_generator.h"
+#include "texture_cache.h"
+#include "weighted_oit.h"
 
 #define WIDTH 1920
 #define HEIGHT 1200
@@ -36,6 +44,10 @@ const unsigned int SCR_HEIGHT = HEIGHT;
 Camera *g_camera = nullptr;
 CameraController *g_cameraController = nullptr;
 
+// framebuffer height in pixels, for projected-size LOD
+int g_viewportWidth = SCR_WIDTH;
+int g_viewportHeight = SCR_HEIGHT;
+
 // timing
 float g_deltaTime = 0.0f;
 
@@ -60,14 +72,22 @@ int main()
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // glfw window creation
     // --------------------
+    // prefer 4.3 (compute shader foliage culling), fall back to 3.3
     GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Fairy Forest Glade", NULL, NULL);
     if (window == NULL)
+    {
+        cout << "OpenGL 4.3 not available, falling back to 3.3" << endl;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Fairy Forest Glade", NULL, NULL);
+    }
+    if (window == NULL)
     {
         cout << "Failed to create GLFW window" << endl;
         glfwTerminate();
@@ -83,6 +103,7 @@ int main()
 
     // glew: initialise and load all OpenGL function pointers
     // ---------------------------------------
+    glewExperimental = GL_TRUE; // needed for core profile function pointers
     if (glewInit() != GLEW_OK)
     {
         cout << "Failed to initialize GLEW" << endl;
@@ -104,13 +125,18 @@ int main()
 
     // LOD (level-of-detail settings)
     //-------------------------------
+    // grass instances stop early, the terrain shades the far field (see terrain.frag)
     LODConfig grassLOD;
     grassLOD.nearDistance = 15.0f;
-    grassLOD.midDistance = 30.0f;
-    grassLOD.farDistance = 55.0f;
+    grassLOD.midDistance = 25.0f;
+    grassLOD.farDistance = 35.0f;
     grassLOD.nearDensity = 1.0f;
     grassLOD.midDensity = 0.5f;
     grassLOD.farDensity = 0.15f;
+    grassLOD.fadeBand = 12.0f; // instances thin out to nothing over the last 12m
+    grassLOD.crossFade = 0.15f; // blades dissolve (dithered) rather than pop as density drops
+    grassLOD.screenSpace = true; // distances above hold at 75 degrees and SCR_HEIGHT, rescaled by zoom and resolution
+    grassLOD.referenceViewportHeight = (float)SCR_HEIGHT;
 
     LODConfig flowerLOD;
     flowerLOD.nearDistance = 25.0f;
@@ -119,11 +145,19 @@ int main()
     flowerLOD.nearDensity = 1.0f;
     flowerLOD.midDensity = 0.5f;
     flowerLOD.farDensity = 0.2f;
+    flowerLOD.crossFade = 0.15f;
+    flowerLOD.screenSpace = true;
+    flowerLOD.referenceViewportHeight = (float)SCR_HEIGHT;
 
     LODConfig treeLOD;
     treeLOD.nearDistance = 30.0f; // Full detail trees
     treeLOD.midDistance = 60.0f;  // Medium detail
     treeLOD.farDistance = 100.0f; // Far trees
+    treeLOD.fadeBand = 10.0f;  // trees dissolve over the last 10m
+    treeLOD.hysteresis = 4.0f; // no flicker for trees sitting on a band edge
+    treeLOD.screenSpace = true;
+    treeLOD.referenceViewportHeight = (float)SCR_HEIGHT;
+    treeLOD.minPixelSize = 2.0f;
 
     // build and compile our shader program
     // ------------------------------------
@@ -134,9 +168,13 @@ int main()
     Shader skyShader("src/shaders/skybox/procedural_sky.vert", "src/shaders/skybox/procedural_sky.frag");
     Shader terrainShader("src/shaders/terrain/terrain.vert", "src/shaders/terrain/terrain.frag", true);
     Shader grassShader("src/shaders/grass/grass.vert", "src/shaders/grass/grass.frag", true);
-    Shader flowerShader("src/shaders/flower/flower.vert", "src/shaders/flower/flower.frag");
+    Shader proceduralGrassShader("src/shaders/grass/grass_procedural.vert", "src/shaders/grass/grass.frag", true);
+    Shader layerShader("src/shaders/foliage/layer.vert", "src/shaders/foliage/layer.frag", true);
     Shader leafShader("src/shaders/tree/leaf.vert", "src/shaders/tree/leaf.frag", true);
     Shader branchShader("src/shaders/tree/branch.vert", "src/shaders/tree/branch.frag", true);
+    Shader impostorShader("src/shaders/tree/impostor.vert", "src/shaders/tree/impostor.frag", true);
+    Shader occlusionBoxShader("src/shaders/tree/occlusion_box.vert", "src/shaders/tree/occlusion_box.frag");
+    // depth prepass and OIT variants are compiled below, only for the passes installed
     Shader fireflyShader("src/shaders/firefly/firefly.vert", "src/shaders/firefly/firefly.frag");
     cout << "Shaders loaded successfully!" << endl;
 
@@ -211,31 +249,117 @@ int main()
     // ===== CREATE FOLIAGE =====
     cout << "Generating foliage..." << endl;
 
-    // grass
-    Foliage grass(&terrain, FoliageType::GRASS,
-                  (int)(300000 * areaRatio),
-                  0.8f, 0.4f, grassLOD);
+    // grass: generated in the vertex shader from gl_InstanceID (no instance data),
+    // streamed per cell around the camera (memory bounded by view distance),
+    // or placed up front for the whole terrain
+    enum class GrassMode
+    {
+        PROCEDURAL,
+        STREAMED,
+        INSTANCED
+    };
+    const GrassMode grassMode = GrassMode::PROCEDURAL;
+    ProceduralGrass *proceduralGrass = nullptr;
+    FoliageStream *streamedGrass = nullptr;
+    Foliage *grass = nullptr;
+    unsigned int grassDensityTexture = 0; // far-field terrain tint
+
+    if (grassMode == GrassMode::PROCEDURAL)
+    {
+        proceduralGrass = new ProceduralGrass(&terrain, grassLOD);
+        grassDensityTexture = proceduralGrass->GetDensityTexture();
+    }
+    else if (grassMode == GrassMode::STREAMED)
+    {
+        streamedGrass = new FoliageStream(&terrain, FoliageType::GRASS,
+                                          (int)(300000 * areaRatio),
+                                          0.8f, 0.4f, grassLOD);
+        grassDensityTexture = streamedGrass->CreateDensityTexture();
+    }
+    else
+    {
+        grass = new Foliage(&terrain, FoliageType::GRASS,
+                            (int)(300000 * areaRatio),
+                            0.8f, 0.4f, grassLOD);
+        grassDensityTexture = grass->CreateDensityTexture();
+
+        // the large layer, upload it as 8-byte packed instances and cull on the GPU when possible
+        grass->SetInstanceFormat(FoliageInstanceFormat::PACKED);
+        grass->EnableGPUCulling("src/shaders/foliage/cull.comp");
+    }
 
-    // flowers
-    Foliage flowers(&terrain, FoliageType::FLOWER,
-                    (int)(5000 * areaRatio),
-                    1.0f, 1.0f, flowerLOD);
+    // data-driven foliage layers, drawn together from one texture array in one call
+    // (a new kind is one more entry here)
+    vector<FoliageLayerDesc> foliageLayers;
+
+    FoliageLayerDesc flowerLayer;
+    flowerLayer.name = "flower";
+    flowerLayer.textures = {"src/assets/textures/flower_1.PNG",
+                            "src/assets/textures/flower_2.PNG"};
+    flowerLayer.count = (int)(5000 * areaRatio);
+    flowerLayer.height = 1.0f;
+    flowerLayer.width = 1.0f;
+    flowerLayer.boundingRadius = 0.7f;
+    flowerLayer.minNormalY = 0.6f;
+    flowerLayer.lod = flowerLOD;
+    flowerLayer.placement.sampling = FoliageSampling::IMPORTANCE; // sparse, place exactly `count`
+    foliageLayers.push_back(flowerLayer);
+
+    // flowers and both tree types decode their textures in one batch, so a file
+    // shared between them is read once; the pixels are freed after the trees
+    TextureCache::BeginBatch();
+    FoliageBatch foliageBatch(&terrain, foliageLayers);
+
+    // cull foliage on the GPU when compute shaders are available (no-op on 3.3)
+    foliageBatch.EnableGPUCulling("src/shaders/foliage/cull.comp");
 
     // trees
-    // load the tree model
-    TreeFoliage normalTree("src/assets/models/foliage/trees/NormalTreeBranch.obj");
+    // grown procedurally on worker threads (no model files), or loaded from the branch models
+    const bool proceduralTrees = true;
+    vector<GeneratedTree> grownTrees;
+    if (proceduralTrees)
+    {
+        TreeSpecies slenderSpecies; // normal type: upright, narrow crown
+        slenderSpecies.seed = 7;
+
+        TreeSpecies stoutSpecies; // thick type: heavier trunk, wider and flatter crown
+        stoutSpecies.seed = 11;
+        stoutSpecies.trunkLength = 2.6f;
+        stoutSpecies.trunkRadius = 0.22f;
+        stoutSpecies.childrenPerBranch = 5;
+        stoutSpecies.lengthRatio = 0.6f;
+        stoutSpecies.branchAngle = 55.0f;
+        stoutSpecies.upwardPull = 0.05f;
+
+        double growStart = glfwGetTime();
+        grownTrees = GenerateTrees({slenderSpecies, stoutSpecies});
+        cout << "Grew " << grownTrees.size() << " procedural trees in "
+             << (glfwGetTime() - growStart) * 1000.0 << " ms" << endl;
+    }
+
+    TreeFoliage normalTree = proceduralTrees ? TreeFoliage(grownTrees[0])
+                                             : TreeFoliage("src/assets/models/foliage/trees/NormalTreeBranch.obj");
     normalTree.LoadLeafTextures({"src/assets/textures/Leaves1.PNG",
                                  "src/assets/textures/Leaves2.PNG",
                                  "src/assets/textures/Leaves3.PNG",
                                  "src/assets/textures/Leaves4.PNG"});
-    normalTree.GenerateLeafClusters(12, 20); // 12 clusters, 20 leaves each
+    // grown trees get a small cluster on each of their ~100-230 leaf anchors
+    if (proceduralTrees)
+        normalTree.GenerateLeafClustersOnAnchors(4); // 4 leaves per anchor
+    else
+        normalTree.GenerateLeafClusters(12, 20); // 12 clusters, 20 leaves each
 
-    TreeFoliage thickTree("src/assets/models/foliage/trees/ThickTreeBranch.obj");
+    TreeFoliage thickTree = proceduralTrees ? TreeFoliage(grownTrees[1])
+                                            : TreeFoliage("src/assets/models/foliage/trees/ThickTreeBranch.obj");
     thickTree.LoadLeafTextures({"src/assets/textures/Leaves1.PNG",
                                 "src/assets/textures/Leaves2.PNG",
                                 "src/assets/textures/Leaves3.PNG",
                                 "src/assets/textures/Leaves4.PNG"});
-    thickTree.GenerateLeafClusters(16, 24); // more leaves for thicker tree (denser foliage)
+    if (proceduralTrees)
+        thickTree.GenerateLeafClustersOnAnchors(3); // more anchors than the slender crown, fewer leaves each
+    else
+        thickTree.GenerateLeafClusters(16, 24); // more leaves for thicker tree (denser foliage)
+    TextureCache::EndBatch();
 
     // tree placements on terrain
     // --------------------------
@@ -245,6 +369,83 @@ int main()
                             fairyStartPos, // Exclusion center
                             7.0f);         // Exclusion radius
 
+    // far trees (LOD 2) as octahedral impostors, baked once under the scene's fixed light
+    leafShader.use();
+    leafShader.setVec3("lightDir", glm::vec3(0.3f, -0.7f, 0.5f));
+    leafShader.setVec3("lightColor", glm::vec3(0.7f, 0.8f, 1.0f));
+    leafShader.setVec3("ambientColor", glm::vec3(0.15f, 0.2f, 0.25f));
+    TreeImpostor normalTreeImpostor(&normalTree, leafShader, branchShader);
+    TreeImpostor thickTreeImpostor(&thickTree, leafShader, branchShader);
+    treeManager.SetImpostors(&normalTreeImpostor, &thickTreeImpostor, &impostorShader);
+
+    // depth prepass per layer: the alpha test runs in a depth-only pass and the colour
+    // pass shades only the visible fragment (GL_EQUAL, no discard). Pays off where
+    // quads overlap a lot (dense grass); flowers and leaves keep their soft blended edges
+    const bool grassDepthPrepass = true;
+    const bool flowerDepthPrepass = false;
+    const bool leafDepthPrepass = false;
+
+    // flowers and leaves as weighted blended OIT: drawn unsorted into accumulation
+    // targets and composited once, instead of sorted alpha blending. Replaces their
+    // depth prepass; branches stay opaque and are sorted front-to-back for early-z
+    const bool transparencyOIT = true;
+    WeightedOIT oit;
+
+    // variants of the alpha-tested shaders (see depth_prepass.h), null when not installed
+    DepthPrepassShaders grassPrepass, layerPrepass, leafPrepass;
+    if (grassDepthPrepass)
+    {
+        const char *grassVert = proceduralGrass ? "src/shaders/grass/grass_procedural.vert" : "src/shaders/grass/grass.vert";
+        grassPrepass = {new Shader(grassVert, "src/shaders/grass/grass.frag", true, DEPTH_PREPASS_DEPTH_ONLY),
+                        new Shader(grassVert, "src/shaders/grass/grass.frag", true, DEPTH_PREPASS_COLOUR)};
+        if (proceduralGrass)
+            proceduralGrass->SetDepthPrepass(grassPrepass);
+        else if (streamedGrass)
+            streamedGrass->SetDepthPrepass(grassPrepass);
+        else
+            grass->SetDepthPrepass(grassPrepass);
+    }
+    if (flowerDepthPrepass && !transparencyOIT)
+    {
+        layerPrepass = {new Shader("src/shaders/foliage/layer.vert", "src/shaders/foliage/layer.frag", true, DEPTH_PREPASS_DEPTH_ONLY),
+                        new Shader("src/shaders/foliage/layer.vert", "src/shaders/foliage/layer.frag", true, DEPTH_PREPASS_COLOUR)};
+        foliageBatch.SetDepthPrepass(layerPrepass);
+    }
+    if (leafDepthPrepass && !transparencyOIT)
+    {
+        leafPrepass = {new Shader("src/shaders/tree/leaf.vert", "src/shaders/tree/leaf.frag", true, DEPTH_PREPASS_DEPTH_ONLY),
+                       new Shader("src/shaders/tree/leaf.vert", "src/shaders/tree/leaf.frag", true, DEPTH_PREPASS_COLOUR)};
+        treeManager.SetDepthPrepass(leafPrepass);
+    }
+
+    // weighted blended OIT variants of the blended layers, and the composite (see weighted_oit.h).
+    // Their alpha-tested depth is still written first (depth-only variants), so canopies
+    // and flowers hide the fireflies and count for the tree occlusion queries; the cost
+    // is that leaves no longer blend through the opaque part of a leaf in front
+    Shader *layerOitShader = nullptr;
+    Shader *leafOitShader = nullptr;
+    Shader *layerOitDepthShader = nullptr;
+    Shader *leafOitDepthShader = nullptr;
+    Shader *oitCompositeShader = nullptr;
+    if (transparencyOIT)
+    {
+        layerOitShader = new Shader("src/shaders/foliage/layer.vert", "src/shaders/foliage/layer.frag", true, WEIGHTED_OIT_ACCUMULATE);
+        leafOitShader = new Shader("src/shaders/tree/leaf.vert", "src/shaders/tree/leaf.frag", true, WEIGHTED_OIT_ACCUMULATE);
+        layerOitDepthShader = new Shader("src/shaders/foliage/layer.vert", "src/shaders/foliage/layer.frag", true, DEPTH_PREPASS_DEPTH_ONLY);
+        leafOitDepthShader = new Shader("src/shaders/tree/leaf.vert", "src/shaders/tree/leaf.frag", true, DEPTH_PREPASS_DEPTH_ONLY);
+        oitCompositeShader = new Shader("src/shaders/oit/composite.vert", "src/shaders/oit/composite.frag");
+
+        foliageBatch.SetDepthOrder(DepthOrder::NONE);
+        treeManager.SetDepthOrder(DepthOrder::FRONT_TO_BACK);
+        treeManager.SetWeightedOIT(leafOitShader, leafOitDepthShader);
+    }
+
+    // tree clusters hidden behind terrain and nearer trees skip their draws on the GPU,
+    // using last frame's occlusion query results
+    const bool treeOcclusionCulling = true;
+    if (treeOcclusionCulling)
+        treeManager.SetOcclusionCulling(&occlusionBoxShader);
+
     cout
         << "Foliage generated!" << endl;
 
@@ -271,57 +472,6 @@ int main()
         cout << "Grass texture loaded!" << endl;
     }
 
-    // FLOWER TEXTURES
-    // Load flower textures
-    unsigned int flowerTex0, flowerTex1;
-
-    // Flower 1
-    glGenTextures(1, &flowerTex0);
-    glBindTexture(GL_TEXTURE_2D, flowerTex0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int width1, height1, channels1;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char *data1 = stbi_load("src/assets/textures/flower_1.PNG", &width1, &height1, &channels1, 0);
-    if (data1)
-    {
-        GLenum format = channels1 == 4 ? GL_RGBA : GL_RGB;
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width1, height1, 0, format, GL_UNSIGNED_BYTE, data1);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(data1);
-        cout << "Flower1 texture loaded! (" << width1 << "x" << height1 << ")" << endl;
-    }
-    else
-    {
-        cout << "Failed to load Flower1.png" << endl;
-    }
-
-    // Flower 2
-    glGenTextures(1, &flowerTex1);
-    glBindTexture(GL_TEXTURE_2D, flowerTex1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int width2, height2, channels2;
-    unsigned char *data2 = stbi_load("src/assets/textures/flower_2.PNG", &width2, &height2, &channels2, 0);
-    if (data2)
-    {
-        GLenum format = channels2 == 4 ? GL_RGBA : GL_RGB;
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width2, height2, 0, format, GL_UNSIGNED_BYTE, data2);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(data2);
-        cout << "Flower2 texture loaded! (" << width2 << "x" << height2 << ")" << endl;
-    }
-    else
-    {
-        cout << "Failed to load Flower2.png" << endl;
-    }
-
     cout << "Textures generated successfully!" << endl;
 
     cout << "Textures generated successfully!" << endl;
@@ -389,8 +539,11 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Setup matrices (used by both objects and skybox)
-        glm::mat4 projection = glm::perspective(glm::radians(75.0f),
-                                                (float)SCR_WIDTH / (float)SCR_HEIGHT,
+        // scroll zoom narrows the field of view (Camera::Zoom is 45 at rest)
+        float fovY = glm::radians(75.0f * camera.Zoom / ZOOM);
+        float aspect = (float)g_viewportWidth / (float)g_viewportHeight;
+        glm::mat4 projection = glm::perspective(fovY,
+                                                aspect,
                                                 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
 
@@ -418,10 +571,11 @@ int main()
 
         // Calculate frustum for foliage culling
         Camera::Frustum frustum = camera.GetFrustum(
-            (float)SCR_WIDTH / (float)SCR_HEIGHT,
-            glm::radians(75.0f),
+            aspect,
+            fovY,
             0.1f,
-            80.0f);
+            80.0f,
+            (float)g_viewportHeight);
 
         // ===== UPDATE ANIMATIONS =====
         fairy.Update(currentFrame, g_deltaTime);
@@ -468,6 +622,16 @@ int main()
         terrainShader.setMat4("projection", projection);
         terrainShader.setMat4("view", view);
 
+        // far-field grass tint fades in over the band where instances fade out
+        terrainShader.setFloat("time", (float)glfwGetTime());
+        terrainShader.setVec2("terrainSize", glm::vec2(terrain.width * terrain.scale, terrain.height * terrain.scale));
+        LODConfig grassViewLOD = grassLOD.ForProjection(frustum.fovY, frustum.viewportHeight, GrassTraits::boundingRadius);
+        terrainShader.setFloat("grassFarStart", grassViewLOD.farDistance - grassViewLOD.fadeBand);
+        terrainShader.setFloat("grassFarEnd", grassViewLOD.farDistance);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, grassDensityTexture);
+        terrainShader.setInt("grassDensityMap", 0);
+
         glm::mat4 terrainModel = glm::mat4(1.0f);
         terrain.drawTerrain(terrainShader, terrainModel);
 
@@ -475,76 +639,122 @@ int main()
         // glDisable(GL_CULL_FACE);
 
         // ===== DRAW GRASS =====
-        grassShader.use();
-        grassShader.setFloat("time", (float)glfwGetTime());
-        grassShader.setMat4("view", view);
-        grassShader.setMat4("projection", projection);
-        grassShader.setVec3("cameraPos", camera.Position);
-        grassShader.setVec3("lightDir", glm::vec3(0.3f, -0.7f, 0.5f));
-        grassShader.setVec3("ambientColor", glm::vec3(0.15f, 0.2f, 0.25f));
-
+        Shader &activeGrassShader = proceduralGrass ? proceduralGrassShader : grassShader;
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, grassTexture);
-        grassShader.setInt("grassTexture", 0);
-
-        grass.Draw(grassShader, view, projection, frustum, camera);
 
-        // ===== DRAW FLOWERS =====
-        if (flowerTex0 != 0 && flowerTex1 != 0)
+        // same uniforms on the installed depth prepass variants, one time for all of
+        // them: the GL_EQUAL colour pass needs the exact depth-pass wind sway
+        for (Shader *program : {&activeGrassShader, grassPrepass.depth, grassPrepass.colour})
         {
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-            flowerShader.use();
-            flowerShader.setFloat("time", (float)glfwGetTime()); // ADD THIS
-            flowerShader.setMat4("view", view);
-            flowerShader.setMat4("projection", projection);
-            flowerShader.setVec3("fairyPos", fairy.GetPosition());
-            flowerShader.setFloat("fairyRadius", 3.0f);
-            flowerShader.setVec3("viewPos", camera.Position);
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, flowerTex0);
-            flowerShader.setInt("flowerTexture0", 0);
+            if (!program)
+                continue;
+            program->use();
+            program->setFloat("time", currentFrame);
+            program->setMat4("view", view);
+            program->setMat4("projection", projection);
+            program->setVec3("cameraPos", camera.Position);
+            program->setVec3("lightDir", glm::vec3(0.3f, -0.7f, 0.5f));
+            program->setVec3("ambientColor", glm::vec3(0.15f, 0.2f, 0.25f));
+            program->setInt("grassTexture", 0);
+        }
 
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, flowerTex1);
-            flowerShader.setInt("flowerTexture1", 1);
+        if (proceduralGrass)
+            proceduralGrass->Draw(activeGrassShader, frustum, camera);
+        else if (streamedGrass)
+            streamedGrass->Draw(activeGrassShader, frustum, camera);
+        else
+            grass->Draw(activeGrassShader, view, projection, frustum, camera);
 
-            flowers.Draw(flowerShader, view, projection, frustum, camera);
+        // ===== DRAW FOLIAGE LAYERS (flowers, ...) =====
+        // with OIT only their alpha-tested depth goes in here, colour waits for the
+        // transparent pass below
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-            glDisable(GL_BLEND);
+        // identical uniforms on every variant: the OIT pass only keeps a layer's own
+        // front fragments if they land exactly on its depth-only pass (GL_LEQUAL)
+        for (Shader *program : {&layerShader, layerPrepass.depth, layerPrepass.colour, layerOitShader, layerOitDepthShader})
+        {
+            if (!program)
+                continue;
+            program->use();
+            program->setFloat("time", currentFrame);
+            program->setMat4("view", view);
+            program->setMat4("projection", projection);
+            program->setVec3("fairyPos", fairy.GetPosition());
+            program->setFloat("fairyRadius", 3.0f);
+            program->setVec3("viewPos", camera.Position);
         }
 
+        if (!transparencyOIT)
+            foliageBatch.Draw(layerShader, frustum, camera);
         else
-        {
-            // Only show once
-            static bool warned = false;
-            if (!warned)
-            {
-                cout << "Skipping flower rendering - textures not loaded" << endl;
-                warned = true;
-            }
-        }
+            foliageBatch.DrawDepth(*layerOitDepthShader, frustum, camera);
+
+        glDisable(GL_BLEND);
 
         // ===== DRAW TREES =====
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        leafShader.use();
-        leafShader.setFloat("time", (float)glfwGetTime());
-        leafShader.setVec3("lightDir", glm::vec3(0.3f, -0.7f, 0.5f));
-        leafShader.setVec3("lightColor", lightColor);
-        leafShader.setVec3("ambientColor", glm::vec3(0.15f, 0.2f, 0.25f));
+        // as above; view, cameraRight/Up and the per-range leafScale are set by
+        // TreeFoliage::DrawLeaves from the same ranges for each variant
+        for (Shader *program : {&leafShader, leafPrepass.depth, leafPrepass.colour, leafOitShader, leafOitDepthShader})
+        {
+            if (!program)
+                continue;
+            program->use();
+            program->setFloat("time", currentFrame);
+            program->setVec3("lightDir", glm::vec3(0.3f, -0.7f, 0.5f));
+            program->setVec3("lightColor", lightColor);
+            program->setVec3("ambientColor", glm::vec3(0.15f, 0.2f, 0.25f));
+        }
 
         branchShader.use();
-        branchShader.setFloat("time", (float)glfwGetTime());
+        branchShader.setFloat("time", currentFrame);
 
         // multiple trees at different positions on the terrain
         treeManager.Draw(leafShader, branchShader, view, projection, frustum, camera);
 
         glDisable(GL_BLEND);
 
+        // ===== DRAW SKYBOX (after the opaque geometry) =====
+        // before the transparent layers, which must composite over it
+        // skybox.Draw(skyboxShader, view, projection);
+        skyShader.use();
+
+        // Pass time for twinkling stars
+        skyShader.setFloat("time", currentFrame);
+
+        // Pass moon direction (same as your main light!)
+        skyShader.setVec3("moonDir", moonDirection);
+
+        // Set matrices
+        glm::mat4 skyView = glm::mat4(glm::mat3(view)); // Remove translation
+        skyShader.setMat4("view", skyView);
+        skyShader.setMat4("projection", projection);
+
+        // Draw skybox
+        skybox.Draw(skyShader, skyView, projection);
+
+        // ===== TRANSPARENT LAYERS (weighted blended OIT) =====
+        if (transparencyOIT)
+        {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            oit.Resize(framebufferWidth, framebufferHeight);
+
+            oit.BeginAccumulation();
+            foliageBatch.Draw(*layerOitShader, frustum, camera);
+            treeManager.DrawTransparent(view, projection, camera);
+            oit.Composite(*oitCompositeShader);
+        }
+
+        // ===== TREE OCCLUSION QUERIES =====
+        // after every tree draw of this frame, next frame's draws wait on the results
+        treeManager.IssueOcclusionQueries(view, projection, camera);
+
         // ===== DRAW FIREFLIES =====
         glDisable(GL_CULL_FACE);
         glEnable(GL_BLEND);
@@ -576,24 +786,6 @@ int main()
         glDisable(GL_BLEND);
         glEnable(GL_CULL_FACE);
 
-        // ===== DRAW SKYBOX (LAST) =====
-        // skybox.Draw(skyboxShader, view, projection);
-        skyShader.use();
-
-        // Pass time for twinkling stars
-        skyShader.setFloat("time", currentFrame);
-
-        // Pass moon direction (same as your main light!)
-        skyShader.setVec3("moonDir", moonDirection);
-
-        // Set matrices
-        glm::mat4 skyView = glm::mat4(glm::mat3(view)); // Remove translation
-        skyShader.setMat4("view", skyView);
-        skyShader.setMat4("projection", projection);
-
-        // Draw skybox
-        skybox.Draw(skyShader, skyView, projection);
-
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
@@ -602,6 +794,17 @@ int main()
 
     // glfw: terminate, clearing all previously allocated GLFWresources.
     //---------------------------------------------------------------
+    if (!proceduralGrass)
+        glDeleteTextures(1, &grassDensityTexture); // ProceduralGrass owns its own
+    delete grass;
+    delete streamedGrass;
+    delete proceduralGrass;
+    for (Shader *program : {grassPrepass.depth, grassPrepass.colour, layerPrepass.depth, layerPrepass.colour,
+                            leafPrepass.depth, leafPrepass.colour, layerOitShader, leafOitShader,
+                            layerOitDepthShader, leafOitDepthShader, oitCompositeShader})
+        delete program;
+    TextureCache::Clear();
+
     glfwTerminate();
     return 0;
 }
@@ -627,6 +830,11 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    if (width > 0 && height > 0)
+    {
+        g_viewportWidth = width;
+        g_viewportHeight = height;
+    }
 }
 
 // glfw: whenever the mouse moves, this callback is called
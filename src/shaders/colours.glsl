@@ -70,6 +70,26 @@ vec3 celShadeSmoothBands(float NdotL, vec3 darkColor, vec3 lightColor, float ban
     return mix(darkColor, lightColor, quantized * smoothFactor);
 }
 
+// ===== SCREEN-DOOR DITHER =====
+// 4x4 ordered (Bayer) threshold in (0, 1) for a pixel; discarding where a dissolve
+// amount exceeds it cross-fades LOD transitions without blending
+float ditherThreshold(vec2 fragCoord) {
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0,
+                                      12.0, 4.0, 14.0, 6.0,
+                                      3.0, 11.0, 1.0, 9.0,
+                                      15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(mod(fragCoord, 4.0));
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+// ===== WEIGHTED BLENDED OIT =====
+// Weight of a transparent fragment (McGuire & Bavoil, eq. 10): near and opaque
+// fragments dominate the average. 1 / gl_FragCoord.w is the view-space distance
+float oitWeight(float alpha, vec4 fragCoord) {
+    float z = 1.0 / fragCoord.w;
+    return alpha * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+}
+
 // Cel-shade with explicit colour ramp (3 bands)
 vec3 celShade3Band(float NdotL, vec3 darkColor, vec3 midColor, vec3 lightColor) {
     if (NdotL > 0.7) return lightColor;
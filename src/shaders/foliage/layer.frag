@@ -0,0 +1,49 @@
+#version 330 core
+#ifdef WEIGHTED_OIT
+layout (location = 0) out vec4 FragColor; // accumulation (see weighted_oit.h)
+layout (location = 1) out float OitWeight;
+#else
+out vec4 FragColor;
+#endif
+
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
+flat in int Slice;
+flat in float Dither;
+in float HeightFactor;
+in float WindInfluence;
+
+// Every layer's textures, one slice each (see FoliageBatch)
+uniform sampler2DArray layerTextures;
+
+// DEPTH_ONLY / DEPTH_EQUAL select the depth prepass variants (see depth_prepass.h),
+// WEIGHTED_OIT the order-independent transparency one (see weighted_oit.h)
+void main() {
+    vec4 texColor = texture(layerTextures, vec3(TexCoords, float(Slice)));
+
+#ifndef DEPTH_EQUAL
+    // Screen-door cross-fade (ditherThreshold from the NPR library)
+    if (Dither >= ditherThreshold(gl_FragCoord.xy)) discard;
+
+    // Discard fully transparent pixels
+    if (texColor.a < 0.01) {
+        discard;
+    }
+#endif
+#ifdef DEPTH_ONLY
+    return;
+#endif
+
+    // Subtle brightness variation from wind
+    float windShimmer = WindInfluence * HeightFactor * 0.1;
+    vec3 finalColor = texColor.rgb * (1.0 + windShimmer);
+
+#ifdef WEIGHTED_OIT
+    float weight = oitWeight(texColor.a, gl_FragCoord);
+    FragColor = vec4(finalColor * texColor.a * weight, texColor.a);
+    OitWeight = texColor.a * weight;
+#else
+    FragColor = vec4(finalColor, texColor.a);
+#endif
+}
@@ -1,23 +1,31 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec3 aPos; // unit billboard, scaled per slice
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 instanceOffset;
-layout (location = 4) in float textureIndex;
+layout (location = 3) in vec3 instancePos;
+layout (location = 4) in float instanceSlice; // texture-array slice
+layout (location = 8) in float instanceDither; // LOD cross-fade dissolve, 0 = solid
+
+#define MAX_SLICES 32 // MAX_FOLIAGE_SLICES in foliage_batch.h
 
 uniform mat4 view;
 uniform mat4 projection;
 uniform vec3 fairyPos;
 uniform float fairyRadius;
 uniform vec3 viewPos;
-uniform float time; // NEW - for wind animation
+uniform float time;
+uniform vec2 sliceSize[MAX_SLICES]; // billboard width, height of each slice's layer
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
-flat out int TexIndex;
-out float HeightFactor; // NEW - for wind
-out float WindInfluence; // NEW - for shader effects
+flat out int Slice;
+flat out float Dither;
+out float HeightFactor;
+out float WindInfluence;
+
+// Same depth in the prepass and colour programs (GL_EQUAL)
+invariant gl_Position;
 
 // Wind noise functions (same as grass)
 vec2 hash(vec2 p) {
@@ -39,59 +47,56 @@ float noise(in vec2 p) {
 }
 
 void main() {
+    Slice = int(instanceSlice + 0.5);
+    Dither = instanceDither;
+    vec2 size = sliceSize[Slice];
+
     // Extract camera RIGHT and UP vectors for billboarding
     vec3 cameraRight = vec3(view[0][0], view[1][0], view[2][0]);
     vec3 cameraUp = vec3(0.0, 1.0, 0.0);
-    
+
     // ===== WIND DISPLACEMENT =====
-    float windSpeed = 0.8; // Slower than grass (flowers are sturdier)
-    float windStrength = 0.15; // Less sway than grass
-    
-    // Sample noise at flower position + scrolling time
-    vec2 windUV = instanceOffset.xz * 0.5 + time * windSpeed * vec2(0.6, 0.4);
-    
-    // Multiple noise layers for complexity
+    float windSpeed = 0.8;
+    float windStrength = 0.15;
+
+    vec2 windUV = instancePos.xz * 0.5 + time * windSpeed * vec2(0.6, 0.4);
+
     float wind1 = noise(windUV) * 0.5 + 0.5;
     float wind2 = noise(windUV * 2.5 + time * 0.8) * 0.5 + 0.5;
     float wind3 = noise(windUV * 0.8 - time * 0.3) * 0.5 + 0.5;
-    
+
     float windNoise = (wind1 * 0.5 + wind2 * 0.3 + wind3 * 0.2) - 0.5;
-    
-    // Height influence - only top of flower sways
-    float heightInfluence = aPos.y * aPos.y; // Quadratic for more bend at top
-    
-    // Wind direction offset
-    vec2 windDirection = vec2(windNoise * windStrength * heightInfluence, 
+
+    // Height influence - only the top sways (aPos.y is 0..1 up the billboard)
+    float heightInfluence = aPos.y * aPos.y;
+
+    vec2 windDirection = vec2(windNoise * windStrength * heightInfluence,
                               windNoise * windStrength * 0.6 * heightInfluence);
-    
-    // Add individual flower variation
-    float flowerVariation = fract(sin(dot(instanceOffset.xz, vec2(12.9898, 78.233))) * 43758.5453);
-    windDirection *= (0.8 + flowerVariation * 0.4);
-    
-    // Apply wind offset to instance position
-    vec3 windOffset = vec3(windDirection.x, 0.0, windDirection.y);
-    vec3 instancePosWithWind = instanceOffset + windOffset;
-    
+
+    float variation = fract(sin(dot(instancePos.xz, vec2(12.9898, 78.233))) * 43758.5453);
+    windDirection *= (0.8 + variation * 0.4);
+
+    vec3 instancePosWithWind = instancePos + vec3(windDirection.x, 0.0, windDirection.y);
+
     // Flora interaction - scale up near fairy
-    float dist = length(vec2(fairyPos.x - instanceOffset.x, fairyPos.z - instanceOffset.z));
+    float dist = length(vec2(fairyPos.x - instancePos.x, fairyPos.z - instancePos.z));
     float influence = smoothstep(fairyRadius, 0.0, dist);
     float extraScale = 1.0 + influence * 0.3;
-    
+
     // Billboard position facing camera
-    vec3 billboardPos = instancePosWithWind 
-                      + cameraRight * aPos.x 
-                      + cameraUp * aPos.y * extraScale;
-    
+    vec3 billboardPos = instancePosWithWind
+                      + cameraRight * aPos.x * size.x
+                      + cameraUp * aPos.y * size.y * extraScale;
+
     FragPos = billboardPos;
     TexCoords = aTexCoords;
-    TexIndex = int(textureIndex);
-    HeightFactor = aPos.y; // Pass to fragment shader
-    WindInfluence = (wind1 + wind2) * 0.5; // Pass wind strength
-    
+    HeightFactor = aPos.y;
+    WindInfluence = (wind1 + wind2) * 0.5;
+
     // Normal faces camera (cylindrical)
-    vec3 toCamera = viewPos - instanceOffset;
+    vec3 toCamera = viewPos - instancePos;
     toCamera.y = 0.0;
     Normal = normalize(toCamera);
-    
+
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
@@ -3,6 +3,7 @@ in vec2 TexCoord;
 in vec3 WorldPos;
 in float HeightFactor;
 in float WindInfluence;
+flat in float Dither;
 
 out vec4 FragColor;
 
@@ -11,10 +12,19 @@ uniform vec3 lightDir;
 uniform float time;
 uniform vec3 ambientColor;
 
+// DEPTH_ONLY / DEPTH_EQUAL select the depth prepass variants (see depth_prepass.h)
 void main() {
     vec4 texColor = texture(grassTexture, TexCoord);
     float alpha = texColor.r;
+
+#ifndef DEPTH_EQUAL
+    // Screen-door cross-fade while the blade's LOD transition is in progress
+    if (Dither >= ditherThreshold(gl_FragCoord.xy)) discard;
     if (alpha < 0.2) discard;
+#endif
+#ifdef DEPTH_ONLY
+    return;
+#endif
     
     vec3 normal = vec3(0.0, 1.0, 0.0);
     float lightIntensity = dot(normalize(-lightDir), normal) * 0.5 + 0.5;
@@ -4,15 +4,28 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
 layout (location = 3) in vec3 aInstancePos;
 
+// Packed instance format (PackedFoliageInstance), attribute 3 is unused then
+layout (location = 5) in vec2 aPackedXZ;   // unorm16 across the layer bounds
+layout (location = 6) in float aPackedY;   // half-float height
+layout (location = 7) in float aPackedRank; // random in [0, 1]
+layout (location = 8) in float aDither;     // LOD cross-fade dissolve from culling, 0 = solid
+
 out vec2 TexCoord;
 out vec3 WorldPos;
 out float HeightFactor;
 out float WindInfluence;
+flat out float Dither;
+
+// Same depth in the prepass and colour programs (GL_EQUAL)
+invariant gl_Position;
 
 uniform mat4 view;
 uniform mat4 projection;
 uniform vec3 cameraPos;
 uniform float time;
+uniform bool packedInstances;
+uniform vec2 instanceOrigin;
+uniform vec2 instanceExtent;
 
 // Wind noise functions
 vec2 hash(vec2 p) {
@@ -33,11 +46,19 @@ float noise(in vec2 p) {
     return dot(n, vec3(70.0));
 }
 
+vec3 instancePosition(vec3 fullPosition) {
+    if (!packedInstances) return fullPosition;
+    vec2 xz = instanceOrigin + aPackedXZ * instanceExtent;
+    return vec3(xz.x, aPackedY, xz.y);
+}
+
 void main() {
     TexCoord = aTexCoord;
+    Dither = aDither;
+    vec3 instancePos = instancePosition(aInstancePos);
     
     // Distance-based LOD scaling
-    float distance = length(cameraPos - aInstancePos);
+    float distance = length(cameraPos - instancePos);
     float scale = 1.0;
     
     if (distance > 15.0) {
@@ -49,7 +70,7 @@ void main() {
     float windStrength = 0.25; // Stronger sway
     
     // Sample noise at grass position + scrolling time
-    vec2 windUV = aInstancePos.xz * 0.5 + time * windSpeed * vec2(0.6, 0.4);
+    vec2 windUV = instancePos.xz * 0.5 + time * windSpeed * vec2(0.6, 0.4);
     
     // Multiple noise layers for complexity
     float wind1 = noise(windUV) * 0.5 + 0.5;
@@ -68,12 +89,13 @@ void main() {
     );
     
     // Add individual blade variation (prevents uniform wave look)
-    float bladeVariation = fract(sin(dot(aInstancePos.xz, vec2(12.9898, 78.233))) * 43758.5453);
+    float bladeVariation = packedInstances ? aPackedRank
+                                           : fract(sin(dot(instancePos.xz, vec2(12.9898, 78.233))) * 43758.5453);
     windDirection *= 0.8 + bladeVariation * 0.4;
     
     // Apply wind offset to instance position
     vec3 windOffset = vec3(windDirection.x, 0.0, windDirection.y);
-    vec3 instancePosWithWind = aInstancePos + windOffset;
+    vec3 instancePosWithWind = instancePos + windOffset;
     
     // Camera-facing billboard (cylindrical)
     vec3 toCamera = normalize(cameraPos - instancePosWithWind);
@@ -0,0 +1,163 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+
+out vec2 TexCoord;
+out vec3 WorldPos;
+out float HeightFactor;
+out float WindInfluence;
+flat out float Dither; // LOD cross-fade dissolve, 0 = solid
+
+// Same depth in the prepass and colour programs (GL_EQUAL)
+invariant gl_Position;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 cameraPos;
+uniform float time;
+
+// Terrain (see ProceduralGrass)
+uniform sampler2D heightMap;  // R32F, one texel per terrain vertex
+uniform sampler2D densityMap; // grass placement density: slope limit and exclusion zones
+uniform vec2 terrainSize;     // world extent, terrain is centred on the origin
+uniform vec2 heightMapSize;   // texels
+uniform float terrainScale;   // metres between terrain vertices
+uniform float minNormalY;
+
+// Cell being drawn
+uniform vec2 cellOrigin;
+uniform float cellSize;
+uniform int cellSeed;
+uniform int bladesPerCell;
+
+// LODConfig density curve sampled into a table (same as cull.comp)
+#define LOD_LUT_SIZE 64
+uniform float lodDensity[LOD_LUT_SIZE + 1];
+uniform float lodToIndex;
+uniform float crossFade;
+
+// Wind noise functions
+vec2 hash(vec2 p) {
+    p = vec2(dot(p, vec2(127.1, 311.7)), dot(p, vec2(269.5, 183.3)));
+    return -1.0 + 2.0 * fract(sin(p) * 43758.5453123);
+}
+
+float noise(in vec2 p) {
+    const float K1 = 0.366025404;
+    const float K2 = 0.211324865;
+    vec2 i = floor(p + (p.x + p.y) * K1);
+    vec2 a = p - i + (i.x + i.y) * K2;
+    vec2 o = (a.x > a.y) ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
+    vec2 b = a - o + K2;
+    vec2 c = a - 1.0 + 2.0 * K2;
+    vec3 h = max(0.5 - vec3(dot(a, a), dot(b, b), dot(c, c)), 0.0);
+    vec3 n = h * h * h * h * vec3(dot(a, hash(i + 0.0)), dot(b, hash(i + o)), dot(c, hash(i + 1.0)));
+    return dot(n, vec3(70.0));
+}
+
+// PCG hash to a float in [0, 1)
+float random01(uint v) {
+    uint h = v * 747796405u + 2891336453u;
+    h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;
+    h = (h >> 22u) ^ h;
+    return float(h >> 8u) / 16777216.0;
+}
+
+float terrainHeight(vec2 xz) {
+    vec2 uv = ((xz + terrainSize * 0.5) / terrainScale + 0.5) / heightMapSize;
+    return texture(heightMap, uv).r;
+}
+
+vec3 terrainNormal(vec2 xz) {
+    float offset = terrainScale;
+    float hL = terrainHeight(xz - vec2(offset, 0.0));
+    float hR = terrainHeight(xz + vec2(offset, 0.0));
+    float hD = terrainHeight(xz - vec2(0.0, offset));
+    float hU = terrainHeight(xz + vec2(0.0, offset));
+    return normalize(vec3(hL - hR, 2.0 * offset, hD - hU));
+}
+
+// Must match FoliageDensityLUT::Sample()
+float sampleLodDensity(float distance) {
+    float x = clamp(distance * lodToIndex, 0.0, float(LOD_LUT_SIZE));
+    int i = min(int(x), LOD_LUT_SIZE - 1);
+    return mix(lodDensity[i], lodDensity[i + 1], x - float(i));
+}
+
+void main() {
+    TexCoord = aTexCoord;
+
+    // ===== PLACEMENT FROM gl_InstanceID =====
+    // R2 low-discrepancy sequence in 32-bit fixed point: every prefix covers the
+    // cell evenly, which is what lets the CPU thin a cell by drawing fewer instances
+    uint seed = uint(cellSeed);
+    uint index = uint(gl_InstanceID);
+    uvec2 start = uvec2(seed * 2654435769u, (seed ^ 0x5bd1e995u) * 2246822519u);
+    uvec2 r2 = start + index * uvec2(3242174889u, 2447445414u);
+    vec2 xz = cellOrigin + vec2(r2 >> 8u) / 16777216.0 * cellSize;
+
+    vec3 instancePos = vec3(xz.x, terrainHeight(xz), xz.y);
+    float distance = length(cameraPos - instancePos);
+
+    // Rejection: slope, density map coverage and this blade's LOD rank
+    float rank = (float(gl_InstanceID) + 0.5) / float(bladesPerCell);
+    float coverage = texture(densityMap, xz / terrainSize + 0.5).r;
+    Dither = 1.0 - clamp((sampleLodDensity(distance) - rank) / max(crossFade, 0.0001), 0.0, 1.0);
+    bool keep = terrainNormal(xz).y > minNormalY &&
+                random01(seed ^ (index * 0x9e3779b9u)) < coverage &&
+                Dither < 1.0;
+    if (!keep) {
+        // Degenerate quad, rasterises nothing
+        WorldPos = vec3(0.0);
+        HeightFactor = 0.0;
+        WindInfluence = 0.0;
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        return;
+    }
+
+    // Distance-based LOD scaling
+    float scale = 1.0;
+    if (distance > 15.0) {
+        scale = mix(1.0, 0.7, clamp((distance - 15.0) / 30.0, 0.0, 1.0));
+    }
+
+    // ===== WIND DISPLACEMENT (as grass.vert) =====
+    float windSpeed = 1.2;
+    float windStrength = 0.25;
+
+    vec2 windUV = instancePos.xz * 0.5 + time * windSpeed * vec2(0.6, 0.4);
+
+    float wind1 = noise(windUV) * 0.5 + 0.5;
+    float wind2 = noise(windUV * 2.5 + time * 0.8) * 0.5 + 0.5;
+    float wind3 = noise(windUV * 0.8 - time * 0.3) * 0.5 + 0.5;
+
+    float windNoise = (wind1 * 0.5 + wind2 * 0.3 + wind3 * 0.2) - 0.5;
+
+    float heightInfluence = aPos.y * aPos.y;
+
+    vec2 windDirection = vec2(
+        windNoise * windStrength * heightInfluence,
+        windNoise * windStrength * 0.6 * heightInfluence
+    );
+
+    float bladeVariation = random01(seed + index);
+    windDirection *= 0.8 + bladeVariation * 0.4;
+
+    vec3 instancePosWithWind = instancePos + vec3(windDirection.x, 0.0, windDirection.y);
+
+    // Camera-facing billboard (cylindrical)
+    vec3 toCamera = normalize(cameraPos - instancePosWithWind);
+    toCamera.y = 0.0;
+    toCamera = normalize(toCamera);
+
+    vec3 up = vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(up, toCamera));
+
+    vec3 worldPos = instancePosWithWind + right * (aPos.x * scale) + up * (aPos.y * scale);
+    WorldPos = worldPos;
+    HeightFactor = aPos.y;
+    WindInfluence = (wind1 + wind2) * 0.5;
+
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+}
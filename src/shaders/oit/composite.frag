@@ -0,0 +1,18 @@
+#version 330 core
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform sampler2D accumTexture;  // rgb: sum of colour * alpha * weight, a: revealage
+uniform sampler2D weightTexture; // r: sum of alpha * weight
+
+void main() {
+    vec4 accum = texture(accumTexture, TexCoord);
+    float revealage = accum.a;
+    if (revealage >= 1.0) discard; // nothing transparent here
+
+    // Weighted average colour
+    float weightSum = texture(weightTexture, TexCoord).r;
+    vec3 averageColor = accum.rgb / max(weightSum, 1e-5);
+
+    FragColor = vec4(averageColor, 1.0 - revealage);
+}
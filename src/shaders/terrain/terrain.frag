@@ -10,6 +10,13 @@ in vec3 VertexColor;
 uniform vec3 viewPos;
 uniform vec3 lightPos;
 uniform vec3 lightColor;
+uniform float time;
+
+// Far-field grass: past the grass instances the terrain itself looks grassy
+uniform sampler2D grassDensityMap; // grass placement density, one texel per terrain quad
+uniform vec2 terrainSize;          // world extent, terrain is centred on the origin
+uniform float grassFarStart;       // grass instances start fading out here...
+uniform float grassFarEnd;         // ...and are gone here (grass LODConfig farDistance)
 
 // Get terrain color based on height
 vec3 getTerrainColor(float height) {
@@ -35,6 +42,20 @@ vec3 getTerrainColor(float height) {
     }
 }
 
+// Blend towards a wind-animated grass colour as the grass instances fade out
+vec3 farFieldGrass(vec3 baseColor, float viewDistance) {
+    float density = texture(grassDensityMap, FragPos.xz / terrainSize + 0.5).r;
+
+    // Two crossing travelling waves stand in for per-blade wind
+    float gust = sin(dot(FragPos.xz, vec2(0.21, 0.13)) + time * 1.2) *
+                 sin(dot(FragPos.xz, vec2(-0.11, 0.27)) - time * 0.7);
+    vec3 grassColor = mix(GRASS_DARK, GRASS_MID, 0.55 + 0.25 * gust);
+
+    // Linear, like the instance fade, so the two sum to a constant and leave no edge
+    float fade = clamp((viewDistance - grassFarStart) / max(grassFarEnd - grassFarStart, 0.0001), 0.0, 1.0);
+    return mix(baseColor, grassColor, density * fade);
+}
+
 void main()
 {
     vec3 norm = normalize(Normal);
@@ -46,6 +67,7 @@ void main()
     // Get base color from height
     float height = FragPos.y;
     vec3 baseColor = getTerrainColor(height);
+    baseColor = farFieldGrass(baseColor, length(viewPos - FragPos));
     
     // Apply cel-shading
     vec3 shadedColor = celShade4Band(
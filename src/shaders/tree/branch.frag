@@ -2,6 +2,7 @@
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+flat in float Dither; // LOD cross-fade dissolve for this tree, 0 = solid
 
 out vec4 FragColor;
 
@@ -9,6 +10,9 @@ uniform vec3 lightDir;
 uniform vec3 viewPos;
 
 void main() {
+    // Screen-door cross-fade (ditherThreshold from the NPR library)
+    if (Dither >= ditherThreshold(gl_FragCoord.xy)) discard;
+
     vec3 N = normalize(Normal);
     vec3 L = normalize(-lightDir);
     vec3 V = normalize(viewPos - FragPos);
@@ -3,11 +3,15 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+// Per tree (TreeDrawInstance)
+layout (location = 7) in mat4 aModel;
+layout (location = 11) in float aLodDither;
+
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out float Dither;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform float time;
@@ -32,7 +36,7 @@ float noise(in vec2 p) {
 }
 
 void main() {
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    vec4 worldPos = aModel * vec4(aPos, 1.0);
     
     // Gentle branch sway (much less than leaves)
     float windSpeed = 0.5;
@@ -55,7 +59,10 @@ void main() {
     worldPos.xyz += windOffset;
     
     FragPos = worldPos.xyz;
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    // Trees only get uniform scale and a yaw, so the model matrix itself transforms
+    // normals (renormalised in the fragment shader), no per-vertex inverse
+    Normal = mat3(aModel) * aNormal;
+    Dither = aLodDither;
     TexCoords = aTexCoords;
     
     gl_Position = projection * view * worldPos;
@@ -0,0 +1,30 @@
+#version 330 core
+in vec2 AtlasUV;
+in vec3 QuadPos;
+flat in vec3 FrameDir;
+flat in float WorldRadius;
+flat in float Dither; // LOD cross-fade dissolve for this tree, 0 = solid
+
+out vec4 FragColor;
+
+uniform sampler2D impostorColour; // lit colour premultiplied by alpha, alpha = coverage
+uniform sampler2D impostorDepth;  // bake depth, 0 = one radius towards the bake camera
+uniform mat4 view;
+uniform mat4 projection;
+
+void main() {
+    vec4 texColor = texture(impostorColour, AtlasUV);
+    if (texColor.a < 0.3) discard; // same cut-off as leaf.frag
+
+    // Screen-door cross-fade (ditherThreshold from the NPR library)
+    if (Dither >= ditherThreshold(gl_FragCoord.xy)) discard;
+
+    // Push the fragment back onto the baked surface so the impostor intersects
+    // terrain and grass like the real tree would
+    float depth = texture(impostorDepth, AtlasUV).r;
+    vec3 surface = QuadPos + FrameDir * (1.0 - 2.0 * depth) * WorldRadius;
+    vec4 clip = projection * view * vec4(surface, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    FragColor = vec4(texColor.rgb / texColor.a, 1.0);
+}
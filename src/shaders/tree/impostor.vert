@@ -0,0 +1,63 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner; // [-1, 1]
+
+// Per tree (TreeDrawInstance)
+layout (location = 7) in mat4 aModel;
+layout (location = 11) in float aLodDither;
+
+out vec2 AtlasUV;
+out vec3 QuadPos;
+flat out vec3 FrameDir;
+flat out float WorldRadius;
+flat out float Dither;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 cameraPos;
+uniform vec3 boundsCenter;   // tree space
+uniform float boundsRadius;
+uniform float framesPerSide;
+uniform float frameInset;    // gutter around each frame, fraction of a frame
+
+// Hemi-octahedral mapping, same as TreeImpostor::EncodeDirection / DecodeDirection
+vec2 encodeDirection(vec3 d) {
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    return vec2(d.x + d.z, d.x - d.z);
+}
+
+vec3 decodeDirection(vec2 uv) {
+    vec2 p = vec2(uv.x + uv.y, uv.x - uv.y) * 0.5;
+    return normalize(vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y));
+}
+
+void main() {
+    Dither = aLodDither;
+
+    // Trees only get uniform scale and a yaw
+    float treeScale = length(aModel[0].xyz);
+    mat3 rotation = mat3(aModel) / treeScale;
+    vec3 worldCenter = (aModel * vec4(boundsCenter, 1.0)).xyz;
+
+    // View direction in tree space, frames only cover the upper hemisphere
+    vec3 toCamera = transpose(rotation) * (cameraPos - worldCenter);
+    toCamera.y = max(toCamera.y, 0.0);
+    vec3 direction = normalize(toCamera + vec3(0.0, 1e-4, 0.0));
+
+    // Nearest baked frame
+    vec2 frame = clamp(floor((encodeDirection(direction) * 0.5 + 0.5) * framesPerSide),
+                       vec2(0.0), vec2(framesPerSide - 1.0));
+    vec3 frameDir = decodeDirection((frame + 0.5) / framesPerSide * 2.0 - 1.0);
+
+    // Same basis as the bake (frameBasis in tree_impostor.cpp)
+    vec3 right = abs(frameDir.y) > 0.999 ? vec3(1.0, 0.0, 0.0)
+                                         : normalize(cross(vec3(0.0, 1.0, 0.0), frameDir));
+    vec3 up = cross(frameDir, right);
+
+    // Quad in the frame's image plane through the tree centre
+    WorldRadius = boundsRadius * treeScale;
+    QuadPos = worldCenter + (rotation * right * aCorner.x + rotation * up * aCorner.y) * WorldRadius;
+    FrameDir = rotation * frameDir;
+    AtlasUV = (frame + frameInset + (aCorner * 0.5 + 0.5) * (1.0 - 2.0 * frameInset)) / framesPerSide;
+
+    gl_Position = projection * view * vec4(QuadPos, 1.0);
+}
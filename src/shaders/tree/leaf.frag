@@ -4,27 +4,36 @@ in vec3 CustomNormal;
 in vec3 WorldPos;
 in float WindInfluence;
 flat in int TexIndex;
+flat in float Dither; // LOD cross-fade dissolve for this tree, 0 = solid
 
+#ifdef WEIGHTED_OIT
+layout (location = 0) out vec4 FragColor; // accumulation (see weighted_oit.h)
+layout (location = 1) out float OitWeight;
+#else
 out vec4 FragColor;
+#endif
 
-uniform sampler2D leafTexture0;
-uniform sampler2D leafTexture1;
-uniform sampler2D leafTexture2;
-uniform sampler2D leafTexture3;
+uniform sampler2DArray leafTextures; // one layer per leaf variant
 uniform vec3 lightDir;
 uniform vec3 lightColor;
 uniform vec3 ambientColor;
 
+// DEPTH_ONLY / DEPTH_EQUAL select the depth prepass variants (see depth_prepass.h),
+// WEIGHTED_OIT the order-independent transparency one (see weighted_oit.h)
 void main() {
-    // Sample texture
-    vec4 texColor;
-    if(TexIndex == 0) texColor = texture(leafTexture0, TexCoord);
-    else if(TexIndex == 1) texColor = texture(leafTexture1, TexCoord);
-    else if(TexIndex == 2) texColor = texture(leafTexture2, TexCoord);
-    else texColor = texture(leafTexture3, TexCoord);
+    // Sample texture (layer index is clamped to the last variant)
+    vec4 texColor = texture(leafTextures, vec3(TexCoord, float(TexIndex)));
     
     float alpha = texColor.r;
+
+#ifndef DEPTH_EQUAL
+    // Screen-door cross-fade (ditherThreshold from the NPR library)
+    if (Dither >= ditherThreshold(gl_FragCoord.xy)) discard;
     if(alpha < 0.3) discard;
+#endif
+#ifdef DEPTH_ONLY
+    return;
+#endif
     
     // Lighting
     vec3 N = normalize(CustomNormal);
@@ -47,5 +56,11 @@ void main() {
     float aoFactor = smoothstep(0.0, 2.0, length(WorldPos));
     shadedColor *= mix(0.5, 1.0, aoFactor);
     
+#ifdef WEIGHTED_OIT
+    float weight = oitWeight(alpha, gl_FragCoord);
+    FragColor = vec4(shadedColor * alpha * weight, alpha);
+    OitWeight = alpha * weight;
+#else
     FragColor = vec4(shadedColor, alpha);
+#endif
 }
@@ -6,18 +6,26 @@ layout (location = 3) in vec3 aCustomNormal;
 layout (location = 4) in float aScale;
 layout (location = 5) in float aTexIndex;
 
+// Per tree (TreeDrawInstance)
+layout (location = 7) in mat4 aModel;
+layout (location = 11) in float aLodDither;
+
 out vec2 TexCoord;
 out vec3 CustomNormal;
 out vec3 WorldPos;
 out float WindInfluence;
 flat out int TexIndex;
+flat out float Dither;
+
+// Same depth in the prepass and colour programs (GL_EQUAL)
+invariant gl_Position;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform vec3 cameraRight;
 uniform vec3 cameraUp;
 uniform float time;
+uniform float leafScale; // > 1 at LODs that draw only part of the leaves
 
 // Wind noise functions
 vec2 hash(vec2 p) {
@@ -41,9 +49,10 @@ float noise(in vec2 p) {
 void main() {
     TexCoord = aTexCoord;
     TexIndex = int(aTexIndex);
+    Dither = aLodDither;
     
     // Transform instance position to world space
-    vec3 worldCenter = (model * vec4(aWorldPos, 1.0)).xyz;
+    vec3 worldCenter = (aModel * vec4(aWorldPos, 1.0)).xyz;
     
     // ===== WIND EFFECT =====
     float windSpeed = 0.7;
@@ -70,7 +79,7 @@ void main() {
     worldCenter += windOffset;
     
     // Billboard facing camera
-    vec3 vertexOffset = (aQuadPos.x * cameraRight + aQuadPos.y * cameraUp) * aScale;
+    vec3 vertexOffset = (aQuadPos.x * cameraRight + aQuadPos.y * cameraUp) * aScale * leafScale;
     WorldPos = worldCenter + vertexOffset;
     
     gl_Position = projection * view * vec4(WorldPos, 1.0);
@@ -79,5 +88,5 @@ void main() {
     WindInfluence = (wind1 + wind2) * 0.5 * heightFactor;
     
     // Transform normal to world space
-    CustomNormal = mat3(model) * aCustomNormal;
+    CustomNormal = mat3(aModel) * aCustomNormal;
 }
@@ -0,0 +1,7 @@
+#version 330 core
+out vec4 FragColor;
+
+// Only the samples passed count matters, colour and depth writes are off
+void main() {
+    FragColor = vec4(1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in vec3 aPos; // unit cube corner, 0..1
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main() {
+    gl_Position = projection * view * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
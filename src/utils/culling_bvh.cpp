@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cfloat>
+using namespace std;
+
+#include "culling_bvh.h"
+
+void CullingBVH::Build(const vector<BoundingSphere> &spheres, int leafSize)
+{
+    nodes.clear();
+    items.resize(spheres.size());
+    for (uint32_t i = 0; i < items.size(); i++)
+        items[i] = i;
+    bounds = spheres;
+
+    if (spheres.empty())
+        return;
+
+    nodes.reserve(2 * spheres.size() / max(1, leafSize) + 1);
+    build(0, (uint32_t)spheres.size(), max(1, leafSize));
+}
+
+uint32_t CullingBVH::build(uint32_t begin, uint32_t end, int leafSize)
+{
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.push_back(Node());
+
+    glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+    glm::vec3 centerMin(FLT_MAX), centerMax(-FLT_MAX);
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const BoundingSphere &sphere = bounds[i];
+        boxMin = glm::min(boxMin, sphere.center - glm::vec3(sphere.radius));
+        boxMax = glm::max(boxMax, sphere.center + glm::vec3(sphere.radius));
+        centerMin = glm::min(centerMin, sphere.center);
+        centerMax = glm::max(centerMax, sphere.center);
+    }
+
+    Node node;
+    node.min = boxMin;
+    node.max = boxMax;
+    node.begin = begin;
+    node.end = end;
+    node.right = 0;
+
+    if ((int)(end - begin) > leafSize)
+    {
+        // Median split along the longest axis of the centres
+        glm::vec3 extent = centerMax - centerMin;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        uint32_t middle = begin + (end - begin) / 2;
+
+        vector<uint32_t> order(end - begin);
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = begin + i;
+        nth_element(order.begin(), order.begin() + (middle - begin), order.end(),
+                    [&](uint32_t a, uint32_t b) { return bounds[a].center[axis] < bounds[b].center[axis]; });
+
+        vector<uint32_t> sortedItems(order.size());
+        vector<BoundingSphere> sortedBounds(order.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+        {
+            sortedItems[i] = items[order[i]];
+            sortedBounds[i] = bounds[order[i]];
+        }
+        copy(sortedItems.begin(), sortedItems.end(), items.begin() + begin);
+        copy(sortedBounds.begin(), sortedBounds.end(), bounds.begin() + begin);
+
+        build(begin, middle, leafSize);
+        node.right = build(middle, end, leafSize);
+    }
+
+    nodes[index] = node;
+    return index;
+}
+
+int CullingBVH::Cull(const Camera::Frustum &frustum, const glm::vec3 &cameraPos, float maxDistance,
+                     vector<uint32_t> &visible, vector<uint8_t> *fullyInside) const
+{
+    if (nodes.empty())
+        return 0;
+
+    const float maxDistanceSq = maxDistance * maxDistance;
+    const uint32_t allPlanes = (1u << 6) - 1;
+
+    auto accept = [&](uint32_t item, bool inside)
+    {
+        visible.push_back(items[item]);
+        if (fullyInside)
+            fullyInside->push_back(inside ? 1 : 0);
+    };
+
+    struct Entry
+    {
+        uint32_t node;
+        uint32_t planeMask; // planes the node is not yet known to be inside
+    };
+    Entry stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = {0, allPlanes};
+    int visited = 0;
+
+    while (stackSize > 0)
+    {
+        Entry entry = stack[--stackSize];
+        const Node &node = nodes[entry.node];
+        visited++;
+
+        // Nearest point of the box beyond range: nothing below can be in range
+        glm::vec3 nearest = glm::clamp(cameraPos, node.min, node.max);
+        glm::vec3 toNearest = nearest - cameraPos;
+        if (glm::dot(toNearest, toNearest) > maxDistanceSq)
+            continue;
+
+        // Test the box corner farthest along each plane normal (outside test) and the
+        // nearest one (inside test); planes the box is inside are dropped for the subtree
+        uint32_t mask = entry.planeMask;
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++)
+        {
+            if (!(mask & (1u << p)))
+                continue;
+            glm::vec3 normal = glm::vec3(frustum.planes[p]);
+            glm::vec3 positive(normal.x >= 0.0f ? node.max.x : node.min.x,
+                               normal.y >= 0.0f ? node.max.y : node.min.y,
+                               normal.z >= 0.0f ? node.max.z : node.min.z);
+            glm::vec3 negative(normal.x >= 0.0f ? node.min.x : node.max.x,
+                               normal.y >= 0.0f ? node.min.y : node.max.y,
+                               normal.z >= 0.0f ? node.min.z : node.max.z);
+            if (glm::dot(normal, positive) + frustum.planes[p].w < 0.0f)
+                outside = true;
+            else if (glm::dot(normal, negative) + frustum.planes[p].w >= 0.0f)
+                mask &= ~(1u << p);
+        }
+        if (outside)
+            continue;
+
+        // Whole subtree inside the frustum and in range: take it without descending
+        glm::vec3 farthest = glm::max(glm::abs(cameraPos - node.min), glm::abs(cameraPos - node.max));
+        if (mask == 0 && glm::dot(farthest, farthest) <= maxDistanceSq)
+        {
+            for (uint32_t i = node.begin; i < node.end; i++)
+                accept(i, true);
+            continue;
+        }
+
+        if (node.right != 0 && stackSize + 2 <= 64)
+        {
+            stack[stackSize++] = {node.right, mask};
+            stack[stackSize++] = {entry.node + 1, mask};
+            continue;
+        }
+
+        // Leaf: the item spheres against the planes still in question
+        for (uint32_t i = node.begin; i < node.end; i++)
+        {
+            const BoundingSphere &sphere = bounds[i];
+            glm::vec3 toCenter = sphere.center - cameraPos;
+            float reach = maxDistance + sphere.radius;
+            if (glm::dot(toCenter, toCenter) > reach * reach)
+                continue;
+
+            bool inFrustum = true;
+            bool inside = true;
+            for (int p = 0; p < 6; p++)
+            {
+                if (!(mask & (1u << p)))
+                    continue;
+                float distance = glm::dot(glm::vec3(frustum.planes[p]), sphere.center) + frustum.planes[p].w;
+                if (distance < -sphere.radius)
+                {
+                    inFrustum = false;
+                    break;
+                }
+                inside &= distance >= sphere.radius;
+            }
+            if (inFrustum)
+                accept(i, inside);
+        }
+    }
+
+    return visited;
+}
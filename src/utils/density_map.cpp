@@ -0,0 +1,174 @@
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#include "density_map.h"
+
+DensityMap::DensityMap(Terrain *terrain, const DensityRules &rules)
+    : rules(rules)
+{
+    cellSize = (float)terrain->scale;
+    cellsX = terrain->width;
+    cellsZ = terrain->height;
+    origin = glm::vec2(-terrain->width * cellSize / 2.0f, -terrain->height * cellSize / 2.0f);
+
+    rasterize(terrain);
+    buildAliasTable();
+}
+
+bool DensityMap::IsExcluded(float x, float z) const
+{
+    for (const auto &zone : rules.exclusions)
+    {
+        if (glm::distance(glm::vec2(x, z), zone.center) < zone.radius)
+            return true;
+    }
+    return false;
+}
+
+void DensityMap::rasterize(Terrain *terrain)
+{
+    // 2x2 sub-samples per texel so partially valid quads get fractional density
+    const int sub = 2;
+    values.assign(cellsX * cellsZ, 0.0f);
+
+    for (int cz = 0; cz < cellsZ; cz++)
+    {
+        for (int cx = 0; cx < cellsX; cx++)
+        {
+            int passed = 0;
+            for (int sz = 0; sz < sub; sz++)
+            {
+                for (int sx = 0; sx < sub; sx++)
+                {
+                    float x = origin.x + (cx + (sx + 0.5f) / sub) * cellSize;
+                    float z = origin.y + (cz + (sz + 0.5f) / sub) * cellSize;
+
+                    if (IsExcluded(x, z))
+                        continue;
+
+                    float y = terrain->getHeight(x, z);
+                    if (y < rules.minHeight || y > rules.maxHeight)
+                        continue;
+
+                    if (terrain->getNormal(x, z).y <= rules.minNormalY)
+                        continue;
+
+                    passed++;
+                }
+            }
+            values[cz * cellsX + cx] = passed / (float)(sub * sub);
+        }
+    }
+}
+
+void DensityMap::buildAliasTable()
+{
+    size_t n = values.size();
+    probability.assign(n, 0.0f);
+    alias.assign(n, 0);
+
+    totalDensity = 0.0f;
+    for (float v : values)
+        totalDensity += v;
+    if (totalDensity <= 0.0f)
+        return;
+
+    // Scale so the average texel weight is 1
+    vector<float> scaled(n);
+    vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; i++)
+    {
+        scaled[i] = values[i] * n / totalDensity;
+        if (scaled[i] < 1.0f)
+            small.push_back((uint32_t)i);
+        else
+            large.push_back((uint32_t)i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        uint32_t s = small.back();
+        small.pop_back();
+        uint32_t l = large.back();
+        large.pop_back();
+
+        probability[s] = scaled[s];
+        alias[s] = l;
+
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0f;
+        if (scaled[l] < 1.0f)
+            small.push_back(l);
+        else
+            large.push_back(l);
+    }
+
+    // Leftovers are 1 up to rounding
+    for (uint32_t l : large)
+        probability[l] = 1.0f;
+    for (uint32_t s : small)
+        probability[s] = 1.0f;
+}
+
+unsigned int DensityMap::CreateTexture() const
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, cellsX, cellsZ, 0, GL_RED, GL_FLOAT, values.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+glm::vec2 DensityMap::Sample(PlacementRng &rng) const
+{
+    glm::vec2 p(0.0f);
+
+    // Texels partially covered by an exclusion zone can still yield a point
+    // inside it; redraw (no terrain queries involved, so this stays cheap)
+    for (int attempt = 0; attempt < 8; attempt++)
+    {
+        uint32_t cell = rng.NextUInt() % (uint32_t)values.size();
+        if (rng.NextFloat() >= probability[cell])
+            cell = alias[cell];
+
+        int cx = cell % cellsX;
+        int cz = cell / cellsX;
+        p = origin + glm::vec2((cx + rng.NextFloat()) * cellSize, (cz + rng.NextFloat()) * cellSize);
+
+        if (!IsExcluded(p.x, p.y))
+            break;
+    }
+    return p;
+}
+
+float DensityMap::GetDensity(float x, float z) const
+{
+    int cx = (int)((x - origin.x) / cellSize);
+    int cz = (int)((z - origin.y) / cellSize);
+    if (cx < 0 || cz < 0 || cx >= cellsX || cz >= cellsZ)
+        return 0.0f;
+    return values[cz * cellsX + cx];
+}
+
+bool DensityMap::Accept(float x, float z) const
+{
+    float density = GetDensity(x, z);
+    if (density <= 0.0f || IsExcluded(x, z))
+        return false;
+    if (density >= 1.0f)
+        return true;
+
+    // Position hash instead of a shared RNG, so the result is thread-safe and stable
+    uint32_t bx, bz;
+    memcpy(&bx, &x, sizeof(bx));
+    memcpy(&bz, &z, sizeof(bz));
+    PlacementRng rng(HashCombine(bx, bz));
+    return rng.NextFloat() < density;
+}
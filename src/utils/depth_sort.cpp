@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <chrono>
+using namespace std;
+
+#include "depth_sort.h"
+
+void DepthSorter::Sort(const float *depths, size_t count, float maxDepth, DepthOrder order)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+    indices.resize(count);
+    for (size_t i = 0; i < count; i++)
+        indices[i] = static_cast<uint32_t>(i);
+
+    if (order == DepthOrder::NONE || count < 2)
+    {
+        lastSortMs = 0.0f;
+        return;
+    }
+
+    // 16-bit keys, flipped for back-to-front so both orders sort ascending
+    keys.resize(count);
+    const float toKey = 65535.0f / max(maxDepth, 0.001f);
+    const uint16_t flip = order == DepthOrder::BACK_TO_FRONT ? 0xffffu : 0u;
+    for (size_t i = 0; i < count; i++)
+    {
+        float d = min(max(depths[i], 0.0f), maxDepth);
+        keys[i] = static_cast<uint16_t>(static_cast<uint16_t>(d * toKey) ^ flip);
+    }
+
+    // Two stable counting passes, low byte then high byte
+    keyScratch.resize(count);
+    indexScratch.resize(count);
+    for (int shift = 0; shift < 16; shift += 8)
+    {
+        uint32_t offsets[256] = {};
+        for (size_t i = 0; i < count; i++)
+            offsets[(keys[i] >> shift) & 0xffu]++;
+
+        uint32_t sum = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            uint32_t c = offsets[b];
+            offsets[b] = sum;
+            sum += c;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t dst = offsets[(keys[i] >> shift) & 0xffu]++;
+            keyScratch[dst] = keys[i];
+            indexScratch[dst] = indices[i];
+        }
+        keys.swap(keyScratch);
+        indices.swap(indexScratch);
+    }
+
+    auto end = chrono::high_resolution_clock::now();
+    lastSortMs = chrono::duration<float, milli>(end - start).count();
+}
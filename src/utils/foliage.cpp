@@ -1,134 +1,465 @@
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
 
-#include <cstdlib>
-#include <ctime>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
-#include <random>
+#include <string>
 using namespace std;
 
 #include "foliage.h"
+#include "poisson_disk.h"
+#include "foliage_cache.h"
 
 Foliage::Foliage(Terrain *terrain, FoliageType type, int count, float height, float width,
-                 const LODConfig &lodConfig)
-    : terrain(terrain), type(type), count(count), height(height), width(width), lodConfig(lodConfig)
+                 const LODConfig &lodConfig, const FoliagePlacement &placement)
+    : terrain(terrain), type(type), count(count), height(height), width(width),
+      lodConfig(lodConfig), placement(placement)
 {
-    string typeName;
-    switch (type)
+    // Per-kind constants from the foliage traits
+    VisitFoliageTraits(type, [this](auto traits)
     {
-    case FoliageType::GRASS:
-        typeName = "grass";
-        boundingRadius = 0.5f;
-        break;
-    case FoliageType::FLOWER:
-        typeName = "flower";
-        boundingRadius = 0.7f;
-        break;
-    }
+        using Traits = decltype(traits);
+        typeName = Traits::name;
+        boundingRadius = Traits::boundingRadius;
+        minNormalY = Traits::minNormalY;
+        ultraNearDistance = Traits::ultraNearDistance;
+        hasTextureIndex = Traits::hasTextureIndex;
+        variantCount = Traits::variantCount;
+    });
+
+    init();
+}
 
-    cout << "Generating " << typeName << " positions..." << endl;
+Foliage::Foliage(Terrain *terrain, const FoliageLayerDesc &layer, int firstSlice)
+    : type(FoliageType::LAYER), batched(true), firstSlice(firstSlice), layerName(layer.name),
+      terrain(terrain), lodConfig(layer.lod), placement(layer.placement),
+      count(layer.count), height(layer.height), width(layer.width)
+{
+    // FoliageBatch sorts all of its layers together
+    depthOrder = DepthOrder::NONE;
+
+    // Per-kind constants from the layer definition
+    typeName = layerName.c_str();
+    boundingRadius = layer.boundingRadius;
+    minNormalY = layer.minNormalY;
+    ultraNearDistance = layer.ultraNearDistance;
+    hasTextureIndex = true;
+    variantCount = max(1, (int)layer.textures.size());
+
+    layerTraits.name = typeName;
+    layerTraits.boundingRadius = boundingRadius;
+    layerTraits.minNormalY = minNormalY;
+    layerTraits.ultraNearDistance = ultraNearDistance;
+
+    init();
+}
 
+void Foliage::init()
+{
     // Pre-allocate memory
     positions.reserve(count);
     visiblePositions.reserve(count / 2);
+    if (hasTextureIndex)
+        visibleTextureIndices.reserve(count / 2);
+
+    // Reuse the placement from disk when nothing that affects it has changed
+    uint64_t key = cacheKey();
+    string cachePath = FoliageCache::GetPath(typeName, key);
+    if (placement.useDiskCache && loadFromCache(cachePath, key))
+    {
+        cout << "Loaded " << positions.size() << " " << typeName << " instances from " << cachePath << endl;
+    }
+    else
+    {
+        placeInstances();
+        if (placement.useDiskCache)
+            saveToCache(cachePath, key);
+    }
+
+    // Cells never change after placement, build their hierarchy once
+    vector<BoundingSphere> cellSpheres;
+    cellSpheres.reserve(cells.size());
+    for (const auto &cell : cells)
+        cellSpheres.push_back({cell.center, cell.radius});
+    cellBVH.Build(cellSpheres);
+
+    // Batched layers are drawn with FoliageBatch's geometry and buffers
+    if (batched)
+        return;
+
+    // Setup cross-quad geometry
+    setupCrossQuad();
+
+    // Setup instance buffers (texture index buffer for flowers only)
+    glGenBuffers(1, &instanceVBO);
+    glGenBuffers(1, &ditherVBO);
+    if (hasTextureIndex)
+        glGenBuffers(1, &textureIndexVBO);
+
+    glBindVertexArray(VAO);
+    bindInstanceAttributes(false);
+    glBindVertexArray(0);
+}
+
+Foliage::~Foliage()
+{
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteBuffers(1, &ditherVBO);
+
+    if (hasTextureIndex)
+    {
+        glDeleteBuffers(1, &textureIndexVBO);
+    }
+
+    // Names that were never generated are 0, which GL ignores
+    if (gpuCulling)
+    {
+        glDeleteVertexArrays(1, &gpuVAO);
+        glDeleteBuffers(1, &allInstanceSSBO);
+        glDeleteBuffers(1, &cullLayerSSBO);
+        glDeleteBuffers(1, &visibleInstanceSSBO);
+        glDeleteBuffers(1, &visibleDitherSSBO);
+        glDeleteBuffers(1, &indirectBuffer);
+        delete cullShader;
+    }
+}
+
+bool Foliage::EnableGPUCulling(const char *computePath)
+{
+    // Compute shaders and SSBOs are core in 4.3; 3.3 contexts stay on the CPU path
+    if (!GLEW_VERSION_4_3)
+    {
+        cout << "GPU foliage culling needs OpenGL 4.3 - using CPU culling" << endl;
+        return false;
+    }
+
+    // Batched layers are culled by FoliageBatch's single dispatch
+    if (batched)
+        return false;
+
+    cullShader = new Shader(computePath);
+
+    glGenBuffers(1, &allInstanceSSBO);
+    glGenBuffers(1, &cullLayerSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullLayerSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(FoliageCullLayer), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &visibleInstanceSSBO);
+    glGenBuffers(1, &visibleDitherSSBO);
+    uploadCullInstances();
+
+    // count, instanceCount, firstIndex, baseVertex, baseInstance
+    GLuint command[5] = {6, 0, 0, 0, 0};
+    glGenBuffers(1, &indirectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // Second VAO that sources instance attributes from the compacted buffer
+    glGenVertexArrays(1, &gpuVAO);
+    glBindVertexArray(gpuVAO);
+    bindQuadGeometry();
+    bindInstanceAttributes(true);
+    glBindVertexArray(0);
+
+    gpuCulling = true;
+    cout << "GPU culling enabled for " << positions.size() << " instances" << endl;
+    return true;
+}
+
+void Foliage::placeInstances()
+{
+    cout << "Generating " << typeName << " positions..." << endl;
 
     // Generate positions on terrain
     generatePositions();
 
-    // For flowers, assign random texture indices
-    if (type == FoliageType::FLOWER)
+    // For flowers and layers, assign random texture indices
+    if (hasTextureIndex)
     {
         textureIndices.resize(positions.size());
-        visibleTextureIndices.reserve(positions.size() / 2);
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+        PlacementRng rng(HashCombine(placement.seed, 0x7e11u));
 
         for (size_t i = 0; i < positions.size(); i++)
         {
-            // 50/50 split between two flower types
-            textureIndices[i] = (dist(gen) < 0.5f) ? 0.0f : 1.0f;
+            // Even split between the kind's textures
+            int variant = min(variantCount - 1, (int)(rng.NextFloat() * variantCount));
+            textureIndices[i] = (float)(firstSlice + variant);
         }
 
-        cout << "  Assigned random flower types" << endl;
+        cout << "  Assigned " << variantCount << " random " << typeName << " variants" << endl;
     }
 
     cout << "Placed " << positions.size() << " " << typeName << " instances" << endl;
 
-    // Setup cross-quad geometry
-    setupCrossQuad();
+    // Sort instances into spatial cells for coarse culling
+    buildCells();
+}
 
-    // Setup instance buffer
-    glGenBuffers(1, &instanceVBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
-    glVertexAttribDivisor(3, 1);
+uint64_t Foliage::cacheKey() const
+{
+    // Everything that feeds generatePositions() and buildCells()
+    CacheKeyBuilder key;
+    key.Add(FoliageCache::VERSION);
+
+    const vector<float> &heights = terrain->getHeightMap();
+    key.Add(heights.data(), heights.size() * sizeof(float));
+    key.Add(terrain->width);
+    key.Add(terrain->height);
+    key.Add(terrain->scale);
+    key.Add(terrain->heightScale);
+
+    key.Add(type);
+    key.Add(layerName.data(), layerName.size());
+    key.Add(firstSlice);
+    key.Add(variantCount);
+    key.Add(count);
+    key.Add(minNormalY);
+    key.Add(cellSize);
+
+    key.Add(placement.seed);
+    key.Add(placement.sampling);
+    key.Add(placement.minSpacing);
+    for (const auto &zone : placement.exclusions)
+    {
+        key.Add(zone.center);
+        key.Add(zone.radius);
+    }
+    return key.hash;
+}
+
+bool Foliage::loadFromCache(const string &path, uint64_t key)
+{
+    FoliageCacheData data;
+    if (!FoliageCache::Load(path, key, data))
+        return false;
+
+    // A flower cache without texture indices (or vice versa) is not ours
+    if (data.textureIndices.size() != (hasTextureIndex ? data.positions.size() : 0))
+        return false;
+
+    positions = move(data.positions);
+    textureIndices = move(data.textureIndices);
+    cells = move(data.cells);
+    return true;
+}
+
+void Foliage::saveToCache(const string &path, uint64_t key) const
+{
+    FoliageCacheData data;
+    data.seed = placement.seed;
+    data.positions = positions;
+    data.textureIndices = textureIndices;
+    data.cells = cells;
+
+    if (FoliageCache::Save(path, key, data))
+        cout << "  Cached " << typeName << " placement to " << path << endl;
+}
 
-    // Setup texture index buffer (flowers only)
-    if (type == FoliageType::FLOWER)
+// Upload every instance in the current format, the compute pass copies survivors verbatim
+void Foliage::uploadCullInstances()
+{
+    size_t stride;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, allInstanceSSBO);
+    if (instanceFormat == FoliageInstanceFormat::PACKED)
     {
-        glGenBuffers(1, &textureIndexVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, textureIndexVBO);
-        glBufferData(GL_ARRAY_BUFFER, textureIndices.size() * sizeof(float),
-                     textureIndices.data(), GL_DYNAMIC_DRAW);
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)0);
-        glVertexAttribDivisor(4, 1);
+        stride = sizeof(PackedFoliageInstance);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, packedInstances.size() * stride,
+                     packedInstances.data(), GL_STATIC_DRAW);
     }
+    else
+    {
+        // xyz = position, w = texture index
+        vector<glm::vec4> allInstances(positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            float texIndex = hasTextureIndex ? textureIndices[i] : 0.0f;
+            allInstances[i] = glm::vec4(positions[i], texIndex);
+        }
 
+        stride = sizeof(glm::vec4);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, allInstances.size() * stride,
+                     allInstances.data(), GL_STATIC_DRAW);
+    }
+
+    // Worst case every instance survives
+    if (visibleInstanceSSBO != 0)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleInstanceSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, positions.size() * stride, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleDitherSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, positions.size() * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Foliage::SetInstanceFormat(FoliageInstanceFormat format)
+{
+    if (format == instanceFormat)
+        return;
+
+    instanceFormat = format;
+    if (instanceFormat == FoliageInstanceFormat::PACKED && packedInstances.empty())
+        packInstances();
+
+    glBindVertexArray(VAO);
+    bindInstanceAttributes(false);
+    if (gpuCulling)
+    {
+        uploadCullInstances();
+        glBindVertexArray(gpuVAO);
+        bindInstanceAttributes(true);
+    }
     glBindVertexArray(0);
+
+    // Refill the instance buffers in the new layout on the next draw
+    visibilityValid = false;
+
+    cout << typeName << " instances: "
+         << (instanceFormat == FoliageInstanceFormat::PACKED ? "packed (8 bytes)" : "full precision") << endl;
 }
 
-Foliage::~Foliage()
+void Foliage::packInstances()
 {
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteBuffers(1, &instanceVBO);
+    packedInstances.resize(positions.size());
+    visiblePackedInstances.reserve(positions.size() / 2);
+    if (positions.empty())
+        return;
 
-    if (type == FoliageType::FLOWER)
+    // Quantise XZ across the layer's bounds (1.5mm steps on a 100m terrain)
+    glm::vec2 minXZ(positions[0].x, positions[0].z);
+    glm::vec2 maxXZ = minXZ;
+    for (const auto &p : positions)
     {
-        glDeleteBuffers(1, &textureIndexVBO);
+        minXZ = glm::min(minXZ, glm::vec2(p.x, p.z));
+        maxXZ = glm::max(maxXZ, glm::vec2(p.x, p.z));
     }
+    instanceOrigin = minXZ;
+    instanceExtent = glm::max(maxXZ - minXZ, glm::vec2(0.001f));
+
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        const glm::vec3 &p = positions[i];
+        PackedFoliageInstance &packed = packedInstances[i];
+
+        glm::vec2 t = (glm::vec2(p.x, p.z) - instanceOrigin) / instanceExtent;
+        packed.x = static_cast<uint16_t>(glm::clamp(t.x, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        packed.z = static_cast<uint16_t>(glm::clamp(t.y, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        packed.y = glm::packHalf1x16(p.y);
+        packed.variant = hasTextureIndex ? static_cast<uint8_t>(textureIndices[i]) : 0;
+        packed.rank = static_cast<uint8_t>(FoliageDensityRank(static_cast<uint32_t>(i)) * 255.0f);
+    }
+
+    size_t fullBytes = positions.size() * (sizeof(glm::vec3) + (hasTextureIndex ? sizeof(float) : 0));
+    cout << "  Packed " << positions.size() << " " << typeName << " instances: "
+         << packedInstances.size() * sizeof(PackedFoliageInstance) / 1024 << " KB (was "
+         << fullBytes / 1024 << " KB)" << endl;
 }
 
-void Foliage::generatePositions()
+// Where this layer may grow (slope limit from the foliage traits)
+DensityRules Foliage::densityRules() const
+{
+    DensityRules rules;
+    rules.minNormalY = minNormalY;
+    rules.exclusions = placement.exclusions;
+    return rules;
+}
+
+// LOD density table for this kind's traits and the current view bands
+FoliageDensityLUT Foliage::densityLUT() const
 {
-    static unsigned int seedOffset = 0;
-    srand(static_cast<unsigned int>(time(0)) + seedOffset++);
+    if (type == FoliageType::LAYER)
+        return BuildFoliageDensityLUT(layerTraits, viewLOD);
 
-    int attempts = count * 2;
-    for (int i = 0; i < attempts && static_cast<int>(positions.size()) < count; i++)
+    FoliageDensityLUT lut;
+    VisitFoliageTraits(type, [&](auto traits)
     {
-        float x = (float(rand()) / RAND_MAX) * terrain->width * terrain->scale - (terrain->width * terrain->scale / 2.0f);
-        float z = (float(rand()) / RAND_MAX) * terrain->height * terrain->scale - (terrain->height * terrain->scale / 2.0f);
+        lut = BuildFoliageDensityLUT(traits, viewLOD);
+    });
+    return lut;
+}
 
-        float y = terrain->getHeight(x, z);
-        glm::vec3 normal = terrain->getNormal(x, z);
+unsigned int Foliage::CreateDensityTexture() const
+{
+    // Rebuilt here, placement may have come from the disk cache
+    DensityMap densityMap(terrain, densityRules());
+    unsigned int texture = densityMap.CreateTexture();
 
-        bool validPlacement = false;
+    cout << "  " << typeName << " density texture: " << densityMap.GetCellsX()
+         << "x" << densityMap.GetCellsZ() << endl;
+    return texture;
+}
 
-        switch (type)
+void Foliage::generatePositions()
+{
+    // Rasterise where this layer may grow
+    DensityMap densityMap(terrain, densityRules());
+
+    if (densityMap.IsEmpty())
+    {
+        cerr << "  No terrain accepts " << typeName << " - nothing placed" << endl;
+        return;
+    }
+
+    uint32_t seed = HashCombine(placement.seed, static_cast<uint32_t>(type));
+
+    if (placement.sampling == FoliageSampling::IMPORTANCE)
+    {
+        // Every sample lands, cost is proportional to count
+        PlacementRng rng(seed);
+        for (int i = 0; i < count; i++)
         {
-        case FoliageType::GRASS:
-            // Grass grows almost anywhere on terrain with reasonable slope
-            validPlacement = (normal.y > 0.5f && y > -999.0f); // Almost no height restriction
-            break;
-
-        case FoliageType::FLOWER:
-            // Flowers prefer flatter areas - VERY permissive on height
-            // validPlacement = (normal.y > 0.65f &&             // Slightly more lenient on slope too
-            //                   y > -terrainHeightScale &&      // Accept even valleys
-            //                   y < terrainHeightScale * 1.2f); // Accept peaks too
-            validPlacement = (normal.y > 0.6f);
-            break;
+            glm::vec2 p = densityMap.Sample(rng);
+            positions.push_back(glm::vec3(p.x, terrain->getHeight(p.x, p.y), p.y));
         }
 
-        if (validPlacement)
-            positions.push_back(glm::vec3(x, y, z));
+        cout << "  Importance-sampled " << count << " positions, seed " << placement.seed << endl;
+        return;
+    }
+
+    float halfWidth = terrain->width * terrain->scale / 2.0f;
+    float halfDepth = terrain->height * terrain->scale / 2.0f;
+    float area = (2.0f * halfWidth) * (2.0f * halfDepth);
+
+    // Dart throwing fills roughly 0.7 * area / spacing^2 points, so derive the
+    // spacing that covers the terrain with about `count` instances
+    float spacing = placement.minSpacing;
+    if (spacing <= 0.0f)
+        spacing = sqrtf(0.7f * area / max(1, count));
+
+    PoissonDiskSettings settings;
+    settings.minCorner = glm::vec2(-halfWidth, -halfDepth);
+    settings.maxCorner = glm::vec2(halfWidth, halfDepth);
+    settings.minSpacing = spacing;
+    settings.seed = seed;
+
+    // Candidates are accepted by the density map, no per-candidate terrain queries
+    vector<glm::vec2> samples = GeneratePoissonDisk(settings, [&densityMap](float x, float z)
+    {
+        return densityMap.Accept(x, z);
+    });
+
+    // Deterministic thinning down to the requested count (partial Fisher-Yates)
+    if (static_cast<int>(samples.size()) > count)
+    {
+        PlacementRng rng(seed);
+        for (int i = 0; i < count; i++)
+        {
+            size_t j = i + rng.NextUInt() % (samples.size() - i);
+            swap(samples[i], samples[j]);
+        }
+        samples.resize(count);
     }
+
+    for (const auto &s : samples)
+        positions.push_back(glm::vec3(s.x, terrain->getHeight(s.x, s.y), s.y));
+
+    cout << "  Poisson-disk spacing " << spacing << "m, seed " << placement.seed << endl;
 }
 
 void Foliage::setupCrossQuad()
@@ -171,6 +502,77 @@ void Foliage::setupCrossQuad()
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
+    bindQuadGeometry();
+
+    glBindVertexArray(0);
+}
+
+// Point the instance attributes of the currently bound VAO at the per-instance data,
+// either the CPU upload buffers or the compute pass's compacted output
+void Foliage::bindInstanceAttributes(bool compacted)
+{
+    for (GLuint attrib = 3; attrib <= 8; attrib++)
+    {
+        glDisableVertexAttribArray(attrib);
+        glVertexAttribDivisor(attrib, 1);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, compacted ? visibleInstanceSSBO : instanceVBO);
+
+    if (instanceFormat == FoliageInstanceFormat::PACKED)
+    {
+        // Unorm16 XZ, half-float Y, variant and rank bytes - converted by the vertex fetch
+        const GLsizei stride = sizeof(PackedFoliageInstance);
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)offsetof(PackedFoliageInstance, x));
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 1, GL_HALF_FLOAT, GL_FALSE, stride, (void *)offsetof(PackedFoliageInstance, y));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride, (void *)offsetof(PackedFoliageInstance, variant));
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 1, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(PackedFoliageInstance, rank));
+    }
+    else if (compacted)
+    {
+        // xyz = position, w = texture index
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *)0);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *)(3 * sizeof(float)));
+    }
+    else
+    {
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+
+        if (hasTextureIndex)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, textureIndexVBO);
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)0);
+        }
+    }
+
+    // Cross-fade dissolve, written by the culling pass alongside the instances
+    glEnableVertexAttribArray(8);
+    if (compacted)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, visibleDitherSSBO);
+        glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)0);
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ditherVBO);
+        glVertexAttribPointer(8, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(uint8_t), (void *)0);
+    }
+}
+
+// Attach the quad VBO/EBO and vertex attributes to the currently bound VAO
+void Foliage::bindQuadGeometry()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
     // Position attribute
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
@@ -182,91 +584,278 @@ void Foliage::setupCrossQuad()
     // TexCoord attribute
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
-
-    glBindVertexArray(0);
 }
 
 void Foliage::Draw(Shader &shader, const glm::mat4 &view, const glm::mat4 &projection,
                    const Camera::Frustum &frustum, const Camera &camera)
 {
-    visiblePositions.clear();
+    // Reuse last frame's visible set while the camera is (nearly) still,
+    // the instance buffers are left untouched on those frames
+    visibilityFrameCount++;
+    if (visibilityValid && isCameraStill(camera, frustum))
+    {
+        visibilityReuseCount++;
+    }
+    else
+    {
+        if (gpuCulling)
+            cullGPU(frustum, camera);
+        else
+            cullCPU(frustum, camera);
+
+        cachedCameraPos = camera.Position;
+        cachedCameraFront = camera.Front;
+        cachedFrustum = frustum;
+        visibilityValid = true;
+    }
 
-    // Clear visible texture indices for flowers
-    if (type == FoliageType::FLOWER)
+    // The GPU path's count arrives once the GPU has finished that cull
+    GLuint count;
+    if (gpuCulling && visibleReadback.Poll(count))
+        visibleCount = static_cast<int>(count);
+
+    if (prepass.Enabled())
     {
-        visibleTextureIndices.clear();
+        DepthPrepass::BeginDepthPass();
+        submit(*prepass.depth);
+        DepthPrepass::BeginColourPass();
+        submit(*prepass.colour);
+        DepthPrepass::End();
+    }
+    else
+    {
+        submit(shader);
     }
 
-    for (size_t idx = 0; idx < positions.size(); idx++)
+    // Debug output
+    static int frameCount = 0;
+    if (++frameCount % 60 == 0)
     {
-        const auto &pos = positions[idx];
+        std::cout << typeName << ": Rendering " << visibleCount
+                  << " / " << positions.size() << " instances ("
+                  << (gpuCulling ? "GPU" : "CPU") << " culling, "
+                  << (int)(GetVisibilityReuseRate() * 100.0f) << "% visibility reuse";
+        if (!gpuCulling && depthOrder != DepthOrder::NONE)
+            std::cout << ", depth sort " << depthSorter.GetLastSortMs() << " ms";
+        if (prepass.Enabled())
+            std::cout << ", depth prepass";
+        std::cout << ")" << std::endl;
+    }
+}
 
-        // Frustum culling
-        if (!camera.IsSphereInFrustum(frustum, pos, boundingRadius))
-        {
+float Foliage::GetVisibilityReuseRate() const
+{
+    if (visibilityFrameCount == 0)
+        return 0.0f;
+    return (float)visibilityReuseCount / (float)visibilityFrameCount;
+}
+
+bool Foliage::isCameraStill(const Camera &camera, const Camera::Frustum &frustum) const
+{
+    float moved = glm::distance(camera.Position, cachedCameraPos);
+    float facing = glm::dot(camera.Front, cachedCameraFront);
+    return moved < reusePositionThreshold && facing > reuseAngleThreshold && frustum.SameProjection(cachedFrustum);
+}
+
+void Foliage::buildCells()
+{
+    float halfWidth = terrain->width * terrain->scale / 2.0f;
+    float halfDepth = terrain->height * terrain->scale / 2.0f;
+    int cellsX = max(1, (int)ceil(2.0f * halfWidth / cellSize));
+    int cellsZ = max(1, (int)ceil(2.0f * halfDepth / cellSize));
+
+    // Cell key per instance
+    vector<uint32_t> keys(positions.size());
+    vector<uint32_t> counts(cellsX * cellsZ + 1, 0);
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        int cx = glm::clamp((int)((positions[i].x + halfWidth) / cellSize), 0, cellsX - 1);
+        int cz = glm::clamp((int)((positions[i].z + halfDepth) / cellSize), 0, cellsZ - 1);
+        keys[i] = cz * cellsX + cx;
+        counts[keys[i] + 1]++;
+    }
+
+    // Counting sort so each cell owns a contiguous range
+    for (size_t c = 1; c < counts.size(); c++)
+        counts[c] += counts[c - 1];
+
+    vector<uint32_t> cursor(counts.begin(), counts.end() - 1);
+    vector<glm::vec3> sortedPositions(positions.size());
+    vector<float> sortedTextureIndices(textureIndices.size());
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        uint32_t dst = cursor[keys[i]]++;
+        sortedPositions[dst] = positions[i];
+        if (!textureIndices.empty())
+            sortedTextureIndices[dst] = textureIndices[i];
+    }
+    positions.swap(sortedPositions);
+    textureIndices.swap(sortedTextureIndices);
+
+    // Bounding sphere per non-empty cell
+    cells.clear();
+    for (int c = 0; c < cellsX * cellsZ; c++)
+    {
+        if (counts[c] == counts[c + 1])
             continue;
+
+        FoliageCell cell;
+        cell.begin = counts[c];
+        cell.end = counts[c + 1];
+
+        glm::vec3 minPos = positions[cell.begin];
+        glm::vec3 maxPos = positions[cell.begin];
+        for (uint32_t i = cell.begin; i < cell.end; i++)
+        {
+            minPos = glm::min(minPos, positions[i]);
+            maxPos = glm::max(maxPos, positions[i]);
         }
+        cell.center = (minPos + maxPos) * 0.5f;
+        cell.radius = glm::length(maxPos - minPos) * 0.5f + boundingRadius;
+        cells.push_back(cell);
+    }
 
-        // Calculate distance
-        float distance = glm::distance(camera.Position, pos);
+    cout << "  Bucketed into " << cells.size() << " cells of " << cellSize << "m" << endl;
+}
 
-        // LOD culling
-        if (distance > lodConfig.farDistance)
-            continue;
+void Foliage::cullGPU(const Camera::Frustum &frustum, const Camera &camera)
+{
+    if (positions.empty())
+        return;
+
+    // Reset the instance count of the indirect command, the compute pass fills it in
+    GLuint zero = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, sizeof(GLuint), sizeof(GLuint), &zero);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    FoliageCullLayer layer = CullLayer(frustum, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullLayerSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(layer), &layer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    cullShader->use();
+    cullShader->setInt("instanceTotal", static_cast<int>(positions.size()));
+    cullShader->setInt("layerCount", 1);
+    for (int i = 0; i < 6; i++)
+        cullShader->setVec4("frustumPlanes[" + to_string(i) + "]", frustum.planes[i]);
+    cullShader->setVec3("cameraPos", camera.Position);
+    cullShader->setBool("packedInstances", instanceFormat == FoliageInstanceFormat::PACKED);
+    cullShader->setVec2("instanceOrigin", instanceOrigin);
+    cullShader->setVec2("instanceExtent", instanceExtent);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, allInstanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleInstanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indirectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, visibleDitherSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cullLayerSSBO);
+
+    GLuint groups = static_cast<GLuint>((positions.size() + 255) / 256);
+    glDispatchCompute(groups, 1, 1);
+
+    // Survivors are consumed as vertex attributes, the counter as the draw command
+    // and (a frame late, never waited on) as the visible count
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    visibleReadback.Copy(indirectBuffer, sizeof(GLuint));
+}
+
+void Foliage::AppendCullInstances(vector<glm::vec4> &out) const
+{
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        float slice = hasTextureIndex ? textureIndices[i] : (float)firstSlice;
+        out.push_back(glm::vec4(positions[i], slice));
+    }
+}
+
+FoliageCullLayer Foliage::CullLayer(const Camera::Frustum &frustum, uint32_t firstInstance)
+{
+    viewLOD = lodConfig.ForProjection(frustum.fovY, frustum.viewportHeight, boundingRadius);
+    FoliageDensityLUT lut = densityLUT();
+
+    FoliageCullLayer layer;
+    layer.firstInstance = firstInstance;
+    layer.instanceCount = static_cast<uint32_t>(positions.size());
+    layer.boundingRadius = boundingRadius;
+    layer.farDistance = viewLOD.farDistance;
+    layer.crossFade = viewLOD.crossFade;
+    layer.lodToIndex = lut.toIndex;
+    copy(begin(lut.values), end(lut.values), layer.lodDensity);
+    return layer;
+}
+
+void Foliage::submit(Shader &shader)
+{
+    shader.use();
+    shader.setBool("packedInstances", instanceFormat == FoliageInstanceFormat::PACKED);
+    shader.setVec2("instanceOrigin", instanceOrigin);
+    shader.setVec2("instanceExtent", instanceExtent);
+    if (gpuCulling)
+        submitGPU();
+    else
+        submitCPU();
+}
+
+void Foliage::submitGPU()
+{
+    if (positions.empty())
+        return;
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBindVertexArray(gpuVAO);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-        // DENSITY SAMPLING with ULTRA-NEAR zone
-        float densityThreshold;
+void Foliage::cullCPU(const Camera::Frustum &frustum, const Camera &camera)
+{
+    visiblePositions.clear();
+    visibleTextureIndices.clear();
+    visiblePackedInstances.clear();
+    visibleDither.clear();
+    visibleDepths.clear();
+
+    runCullKernel(frustum, camera);
 
-        if (type == FoliageType::GRASS)
+    // Reorder every per-instance stream by view depth before upload
+    if (depthOrder != DepthOrder::NONE)
+    {
+        depthSorter.Sort(visibleDepths.data(), visibleDepths.size(), viewLOD.farDistance, depthOrder);
+        depthSorter.Apply(visibleDither);
+        if (instanceFormat == FoliageInstanceFormat::PACKED)
         {
-            // GRASS: Ultra-dense within 8m, then normal LOD
-            if (distance < 8.0f)
-            {
-                densityThreshold = 1.0f; // 100% density carpet
-            }
-            else if (distance < lodConfig.nearDistance)
-            {
-                // Smooth transition from ultra-near to near
-                float t = (distance - 8.0f) / (lodConfig.nearDistance - 8.0f);
-                densityThreshold = glm::mix(1.0f, lodConfig.nearDensity, t);
-            }
-            else
-            {
-                densityThreshold = lodConfig.GetDensityMultiplier(distance);
-            }
+            depthSorter.Apply(visiblePackedInstances);
         }
         else
         {
-            // Other foliage uses normal LOD
-            densityThreshold = lodConfig.GetDensityMultiplier(distance);
+            depthSorter.Apply(visiblePositions);
+            if (hasTextureIndex)
+                depthSorter.Apply(visibleTextureIndices);
         }
+    }
 
-        // Deterministic hash for stable sampling
-        unsigned int hash = (unsigned int)(pos.x * 73856093) ^
-                            (unsigned int)(pos.z * 19349663);
-        float random = (hash % 1000) / 1000.0f;
-
-        if (random < densityThreshold)
-        {
-            visiblePositions.push_back(pos);
-
-            // Track texture index for visible flowers
-            if (type == FoliageType::FLOWER)
-            {
-                visibleTextureIndices.push_back(textureIndices[idx]);
-            }
-        }
+    if (!visibleDither.empty())
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ditherVBO);
+        glBufferData(GL_ARRAY_BUFFER, visibleDither.size(), visibleDither.data(), GL_DYNAMIC_DRAW);
     }
 
-    // Debug output
-    static int frameCount = 0;
-    if (++frameCount % 60 == 0)
+    if (instanceFormat == FoliageInstanceFormat::PACKED)
     {
-        std::string typeName = (type == FoliageType::GRASS) ? "Grass" : "Flowers";
-        std::cout << typeName << ": Rendering " << visiblePositions.size()
-                  << " / " << positions.size() << " instances (LOD active)" << std::endl;
+        visibleCount = static_cast<int>(visiblePackedInstances.size());
+        if (visibleCount == 0)
+            return;
+
+        // One interleaved 8-byte stream instead of positions + texture indices
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, visiblePackedInstances.size() * sizeof(PackedFoliageInstance),
+                     visiblePackedInstances.data(), GL_DYNAMIC_DRAW);
+        return;
     }
 
+    visibleCount = static_cast<int>(visiblePositions.size());
+
     if (visiblePositions.empty())
         return;
 
@@ -276,15 +865,139 @@ void Foliage::Draw(Shader &shader, const glm::mat4 &view, const glm::mat4 &proje
                  visiblePositions.data(), GL_DYNAMIC_DRAW);
 
     // Update texture index buffer (flowers only)
-    if (type == FoliageType::FLOWER)
+    if (hasTextureIndex)
     {
         glBindBuffer(GL_ARRAY_BUFFER, textureIndexVBO);
         glBufferData(GL_ARRAY_BUFFER, visibleTextureIndices.size() * sizeof(float),
                      visibleTextureIndices.data(), GL_DYNAMIC_DRAW);
     }
+}
+
+// One dispatch per frame into the kernel specialised for this foliage kind
+void Foliage::runCullKernel(const Camera::Frustum &frustum, const Camera &camera)
+{
+    viewLOD = lodConfig.ForProjection(frustum.fovY, frustum.viewportHeight, boundingRadius);
+
+    if (type == FoliageType::LAYER)
+    {
+        cullKernel(layerTraits, frustum, camera);
+        return;
+    }
+
+    VisitFoliageTraits(type, [&](auto traits)
+    {
+        cullKernel(traits, frustum, camera);
+    });
+}
+
+void Foliage::CullInto(const Camera::Frustum &frustum, const Camera &camera,
+                       vector<glm::vec4> &out, vector<uint8_t> &outDither)
+{
+    visiblePositions.clear();
+    visibleTextureIndices.clear();
+    visibleDither.clear();
+
+    runCullKernel(frustum, camera);
+
+    visibleCount = static_cast<int>(visiblePositions.size());
+    for (size_t i = 0; i < visiblePositions.size(); i++)
+    {
+        float slice = hasTextureIndex ? visibleTextureIndices[i] : (float)firstSlice;
+        out.push_back(glm::vec4(visiblePositions[i], slice));
+    }
+    outDither.insert(outDither.end(), visibleDither.begin(), visibleDither.end());
+}
+
+template <typename Traits>
+void Foliage::cullKernel(const Traits &traits, const Camera::Frustum &frustum, const Camera &camera)
+{
+    const glm::vec3 cameraPos = camera.Position;
+    const float farDistance = viewLOD.farDistance;
+    const bool packed = instanceFormat == FoliageInstanceFormat::PACKED;
+    const float crossFade = viewLOD.crossFade;
+    const bool collectDepths = depthOrder != DepthOrder::NONE;
+    const glm::vec3 cameraFront = camera.Front;
+
+    // Density curve as a table, one lerp per instance instead of the band branches
+    const FoliageDensityLUT lut = BuildFoliageDensityLUT(traits, viewLOD);
+
+    glm::vec3 planeNormals[6];
+    float planeOffsets[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeNormals[p] = glm::vec3(frustum.planes[p]);
+        planeOffsets[p] = frustum.planes[p].w;
+    }
+
+    visibleMask.resize(positions.size());
+    ditherScratch.resize(positions.size());
+
+    // Cells touching the frustum within the far LOD distance, from the hierarchy
+    candidateCells.clear();
+    candidateCellInside.clear();
+    cellBVH.Cull(frustum, cameraPos, farDistance, candidateCells, &candidateCellInside);
+
+    for (size_t c = 0; c < candidateCells.size(); c++)
+    {
+        const FoliageCell &cell = cells[candidateCells[c]];
+
+        // Cells entirely inside the frustum pass every plane test
+        const bool fullyInside = candidateCellInside[c] != 0;
+
+        // Pass 1: visibility mask, no data-dependent branches so the loop vectorises
+        for (uint32_t idx = cell.begin; idx < cell.end; idx++)
+        {
+            const glm::vec3 pos = positions[idx];
+
+            bool inFrustum = fullyInside;
+            bool insideAll = true;
+            for (int p = 0; p < 6; p++)
+                insideAll &= (glm::dot(planeNormals[p], pos) + planeOffsets[p] >= -traits.boundingRadius);
+            inFrustum |= insideAll;
+
+            float distance = glm::distance(cameraPos, pos);
+            float densityThreshold = lut.Sample(distance);
+
+            // Deterministic per-instance rank for stable sampling (shared with the GPU path)
+            float random = FoliageDensityRank(idx);
+
+            // Instances just above the threshold dissolve instead of popping
+            float dither = FoliageDither(densityThreshold, random, crossFade);
+            ditherScratch[idx] = static_cast<uint8_t>(dither * 255.0f);
+
+            visibleMask[idx] = inFrustum & (distance <= farDistance) & (dither < 1.0f);
+        }
+
+        // Pass 2: compact survivors and the attributes this kind carries
+        for (uint32_t idx = cell.begin; idx < cell.end; idx++)
+        {
+            if (!visibleMask[idx])
+                continue;
+
+            visibleDither.push_back(ditherScratch[idx]);
+            if (collectDepths)
+                visibleDepths.push_back(DepthSorter::ViewDepth(positions[idx], cameraPos, cameraFront));
+
+            if (packed)
+            {
+                visiblePackedInstances.push_back(packedInstances[idx]);
+                continue;
+            }
+
+            visiblePositions.push_back(positions[idx]);
+            if constexpr (Traits::hasTextureIndex)
+                visibleTextureIndices.push_back(textureIndices[idx]);
+        }
+    }
+}
+
+void Foliage::submitCPU()
+{
+    if (visibleCount == 0)
+        return;
 
     glBindVertexArray(VAO);
     glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0,
-                            static_cast<GLsizei>(visiblePositions.size()));
+                            static_cast<GLsizei>(visibleCount));
     glBindVertexArray(0);
 }
@@ -0,0 +1,377 @@
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "foliage_batch.h"
+#include "texture_cache.h"
+
+FoliageBatch::FoliageBatch(Terrain *terrain, const vector<FoliageLayerDesc> &layerDescs)
+{
+    cout << "Building foliage batch with " << layerDescs.size() << " layers..." << endl;
+
+    // Each layer owns a contiguous run of slices, one per texture
+    for (const auto &desc : layerDescs)
+    {
+        int slices = max(1, (int)desc.textures.size());
+        int firstSlice = (int)slicePaths.size();
+        if (firstSlice + slices > MAX_FOLIAGE_SLICES)
+        {
+            cerr << "  Skipping foliage layer " << desc.name << ": more than "
+                 << MAX_FOLIAGE_SLICES << " texture slices in one batch" << endl;
+            continue;
+        }
+
+        for (int i = 0; i < slices; i++)
+        {
+            slicePaths.push_back(i < (int)desc.textures.size() ? desc.textures[i] : string());
+            sliceSizes.push_back(glm::vec2(desc.width, desc.height));
+        }
+
+        layers.push_back(new Foliage(terrain, desc, firstSlice));
+        instanceTotal += layers.back()->positions.size();
+    }
+
+    // Shared with any other batch using the same textures
+    textureArray = TextureCache::GetArray(slicePaths, "foliage texture");
+    setupQuad();
+
+    glGenBuffers(1, &instanceVBO);
+    glGenBuffers(1, &ditherVBO);
+    glBindVertexArray(VAO);
+    bindInstanceAttributes(instanceVBO, ditherVBO, false);
+    glBindVertexArray(0);
+
+    visibleInstances.reserve(instanceTotal / 2);
+
+    cout << "Foliage batch ready: " << layers.size() << " layers, " << slicePaths.size()
+         << " slices, " << instanceTotal << " instances" << endl;
+}
+
+FoliageBatch::~FoliageBatch()
+{
+    for (Foliage *layer : layers)
+        delete layer;
+
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteBuffers(1, &ditherVBO);
+
+    if (gpuCulling)
+    {
+        glDeleteVertexArrays(1, &gpuVAO);
+        glDeleteBuffers(1, &allInstanceSSBO);
+        glDeleteBuffers(1, &cullLayerSSBO);
+        glDeleteBuffers(1, &visibleInstanceSSBO);
+        glDeleteBuffers(1, &visibleDitherSSBO);
+        glDeleteBuffers(1, &indirectBuffer);
+        delete cullShader;
+    }
+}
+
+void FoliageBatch::setupQuad()
+{
+    // Unit billboard (1m wide, 1m tall, base at the origin), scaled per slice in the shader
+    // Position (XYZ), Normal (XYZ), TexCoord (UV)
+    float vertices[] = {
+        -0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+        0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+        0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
+        -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f};
+
+    unsigned int indices[] = {
+        0, 1, 2,
+        0, 2, 3};
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    bindQuadGeometry();
+
+    glBindVertexArray(0);
+}
+
+// Attach the quad VBO/EBO and vertex attributes to the currently bound VAO
+void FoliageBatch::bindQuadGeometry()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+}
+
+// xyz = position, w = texture-array slice, plus the cross-fade dissolve
+// (unorm8 from the CPU path, float from the compute pass)
+void FoliageBatch::bindInstanceAttributes(unsigned int buffer, unsigned int ditherBuffer, bool floatDither)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *)0);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *)(3 * sizeof(float)));
+    glVertexAttribDivisor(4, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, ditherBuffer);
+    glEnableVertexAttribArray(8);
+    if (floatDither)
+        glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)0);
+    else
+        glVertexAttribPointer(8, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(uint8_t), (void *)0);
+    glVertexAttribDivisor(8, 1);
+}
+
+bool FoliageBatch::EnableGPUCulling(const char *computePath)
+{
+    if (!GLEW_VERSION_4_3)
+    {
+        cout << "GPU foliage culling needs OpenGL 4.3 - batch uses CPU culling" << endl;
+        return false;
+    }
+
+    // One program and one dispatch for all layers: their instances are concatenated
+    // and each thread finds its layer's parameters in the CullLayers buffer
+    cullShader = new Shader(computePath);
+
+    vector<glm::vec4> allInstances;
+    allInstances.reserve(instanceTotal);
+    for (Foliage *layer : layers)
+        layer->AppendCullInstances(allInstances);
+
+    glGenBuffers(1, &allInstanceSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, allInstanceSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(1, allInstances.size()) * sizeof(glm::vec4),
+                 allInstances.data(), GL_STATIC_DRAW);
+
+    cullLayers.resize(layers.size());
+    glGenBuffers(1, &cullLayerSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullLayerSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(1, cullLayers.size()) * sizeof(FoliageCullLayer),
+                 nullptr, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &visibleInstanceSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleInstanceSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(1, instanceTotal) * sizeof(glm::vec4),
+                 nullptr, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &visibleDitherSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleDitherSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(1, instanceTotal) * sizeof(float),
+                 nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // count, instanceCount, firstIndex, baseVertex, baseInstance
+    GLuint command[5] = {6, 0, 0, 0, 0};
+    glGenBuffers(1, &indirectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenVertexArrays(1, &gpuVAO);
+    glBindVertexArray(gpuVAO);
+    bindQuadGeometry();
+    bindInstanceAttributes(visibleInstanceSSBO, visibleDitherSSBO, true);
+    glBindVertexArray(0);
+
+    gpuCulling = true;
+    visibilityValid = false;
+    cout << "GPU culling enabled for foliage batch (" << instanceTotal << " instances)" << endl;
+    return true;
+}
+
+bool FoliageBatch::isCameraStill(const Camera &camera, const Camera::Frustum &frustum) const
+{
+    float moved = glm::distance(camera.Position, cachedCameraPos);
+    float facing = glm::dot(camera.Front, cachedCameraFront);
+    return moved < reusePositionThreshold && facing > reuseAngleThreshold && frustum.SameProjection(cachedFrustum);
+}
+
+void FoliageBatch::cullCPU(const Camera::Frustum &frustum, const Camera &camera)
+{
+    visibleInstances.clear();
+    visibleDither.clear();
+    for (Foliage *layer : layers)
+        layer->CullInto(frustum, camera, visibleInstances, visibleDither);
+
+    visibleCount = static_cast<int>(visibleInstances.size());
+    if (visibleInstances.empty())
+        return;
+
+    // One sort across all layers, they share the draw
+    if (depthOrder != DepthOrder::NONE)
+    {
+        visibleDepths.resize(visibleInstances.size());
+        float maxDepth = 0.0f;
+        for (size_t i = 0; i < visibleInstances.size(); i++)
+        {
+            visibleDepths[i] = DepthSorter::ViewDepth(glm::vec3(visibleInstances[i]), camera.Position, camera.Front);
+            maxDepth = max(maxDepth, visibleDepths[i]);
+        }
+
+        depthSorter.Sort(visibleDepths.data(), visibleDepths.size(), maxDepth, depthOrder);
+        depthSorter.Apply(visibleInstances);
+        depthSorter.Apply(visibleDither);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, visibleInstances.size() * sizeof(glm::vec4),
+                 visibleInstances.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, ditherVBO);
+    glBufferData(GL_ARRAY_BUFFER, visibleDither.size(), visibleDither.data(), GL_DYNAMIC_DRAW);
+}
+
+void FoliageBatch::cullGPU(const Camera::Frustum &frustum, const Camera &camera)
+{
+    // One counter for the whole batch, every layer's survivors append to it
+    GLuint zero = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, sizeof(GLuint), sizeof(GLuint), &zero);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    uint32_t firstInstance = 0;
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        cullLayers[l] = layers[l]->CullLayer(frustum, firstInstance);
+        firstInstance += cullLayers[l].instanceCount;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullLayerSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cullLayers.size() * sizeof(FoliageCullLayer), cullLayers.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    cullShader->use();
+    cullShader->setInt("instanceTotal", static_cast<int>(instanceTotal));
+    cullShader->setInt("layerCount", static_cast<int>(layers.size()));
+    for (int i = 0; i < 6; i++)
+        cullShader->setVec4("frustumPlanes[" + to_string(i) + "]", frustum.planes[i]);
+    cullShader->setVec3("cameraPos", camera.Position);
+    cullShader->setBool("packedInstances", false);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, allInstanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleInstanceSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indirectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, visibleDitherSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cullLayerSSBO);
+
+    GLuint groups = static_cast<GLuint>((instanceTotal + 255) / 256);
+    glDispatchCompute(groups, 1, 1);
+
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    visibleReadback.Copy(indirectBuffer, sizeof(GLuint));
+}
+
+void FoliageBatch::updateVisibility(const Camera::Frustum &frustum, const Camera &camera)
+{
+    // The GPU path's count arrives once the GPU has finished that cull, never waited on
+    GLuint count;
+    if (gpuCulling && visibleReadback.Poll(count))
+        visibleCount = static_cast<int>(count);
+
+    if (visibilityValid && isCameraStill(camera, frustum))
+        return;
+
+    if (gpuCulling)
+        cullGPU(frustum, camera);
+    else
+        cullCPU(frustum, camera);
+
+    cachedCameraPos = camera.Position;
+    cachedCameraFront = camera.Front;
+    cachedFrustum = frustum;
+    visibilityValid = true;
+}
+
+void FoliageBatch::DrawDepth(Shader &depthShader, const Camera::Frustum &frustum, const Camera &camera)
+{
+    if (layers.empty())
+        return;
+
+    updateVisibility(frustum, camera);
+
+    DepthPrepass::BeginDepthPass();
+    submit(depthShader);
+    DepthPrepass::End();
+}
+
+void FoliageBatch::Draw(Shader &shader, const Camera::Frustum &frustum, const Camera &camera)
+{
+    if (layers.empty())
+        return;
+
+    updateVisibility(frustum, camera);
+
+    if (prepass.Enabled())
+    {
+        DepthPrepass::BeginDepthPass();
+        submit(*prepass.depth);
+        DepthPrepass::BeginColourPass();
+        submit(*prepass.colour);
+        DepthPrepass::End();
+    }
+    else
+    {
+        submit(shader);
+    }
+
+    // Debug output
+    static int frameCount = 0;
+    if (++frameCount % 60 == 0)
+    {
+        cout << "Foliage batch: Rendering " << visibleCount << " / " << instanceTotal
+             << " instances from " << layers.size() << " layers in 1 draw ("
+             << (gpuCulling ? "GPU" : "CPU") << " culling";
+        if (!gpuCulling && depthOrder != DepthOrder::NONE)
+            cout << ", depth sort " << depthSorter.GetLastSortMs() << " ms";
+        if (prepass.Enabled())
+            cout << ", depth prepass";
+        cout << ")" << endl;
+    }
+}
+
+void FoliageBatch::submit(Shader &shader)
+{
+    shader.use();
+
+    // Per-slice billboard sizes only change with the program
+    if (find(sizesUploadedTo.begin(), sizesUploadedTo.end(), shader.ID) == sizesUploadedTo.end())
+    {
+        for (size_t i = 0; i < sliceSizes.size(); i++)
+            shader.setVec2("sliceSize[" + to_string(i) + "]", sliceSizes[i]);
+        sizesUploadedTo.push_back(shader.ID);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+    shader.setInt("layerTextures", 0);
+
+    if (gpuCulling)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBindVertexArray(gpuVAO);
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else if (visibleCount > 0)
+    {
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0,
+                                static_cast<GLsizei>(visibleCount));
+    }
+    glBindVertexArray(0);
+}
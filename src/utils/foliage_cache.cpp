@@ -0,0 +1,185 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "foliage_cache.h"
+
+namespace
+{
+    const uint32_t CACHE_MAGIC = 0x43474646; // "FFGC"
+
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t seed;
+        uint32_t positionCount;
+        uint32_t textureIndexCount;
+        uint32_t cellCount;
+    };
+
+    // Read-only mapping of a whole file
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const string &path)
+        {
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return;
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+                return;
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping == NULL)
+                return;
+            data = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            size = (size_t)fileSize.QuadPart;
+#else
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0)
+                return;
+            void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+                return;
+            data = static_cast<const unsigned char *>(mapped);
+            size = (size_t)st.st_size;
+#endif
+        }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (data)
+                UnmapViewOfFile(data);
+            if (mapping != NULL)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+#else
+            if (data)
+                munmap(const_cast<unsigned char *>(data), size);
+            if (fd >= 0)
+                close(fd);
+#endif
+        }
+
+        const unsigned char *Data() const { return data; }
+        size_t Size() const { return size; }
+
+    private:
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+#else
+        int fd = -1;
+#endif
+    };
+
+    template <typename T>
+    void copyArray(const unsigned char *&cursor, vector<T> &out, uint32_t count)
+    {
+        out.resize(count);
+        if (count > 0)
+            memcpy(out.data(), cursor, count * sizeof(T));
+        cursor += count * sizeof(T);
+    }
+}
+
+string FoliageCache::GetPath(const string &layerName, uint64_t key)
+{
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    return "cache/foliage_" + layerName + "_" + hex + ".bin";
+}
+
+bool FoliageCache::Load(const string &path, uint64_t key, FoliageCacheData &data)
+{
+    MappedFile file(path);
+    if (!file.Data() || file.Size() < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != CACHE_MAGIC || header.version != VERSION || header.key != key)
+    {
+        cout << "  Stale foliage cache ignored: " << path << endl;
+        return false;
+    }
+
+    size_t expected = sizeof(CacheHeader) +
+                      header.positionCount * sizeof(glm::vec3) +
+                      header.textureIndexCount * sizeof(float) +
+                      header.cellCount * sizeof(FoliageCell);
+    if (file.Size() != expected)
+    {
+        cerr << "  Truncated foliage cache ignored: " << path << endl;
+        return false;
+    }
+
+    // Straight copies out of the mapping, no per-instance work
+    const unsigned char *cursor = file.Data() + sizeof(CacheHeader);
+    data.seed = header.seed;
+    copyArray(cursor, data.positions, header.positionCount);
+    copyArray(cursor, data.textureIndices, header.textureIndexCount);
+    copyArray(cursor, data.cells, header.cellCount);
+    return true;
+}
+
+bool FoliageCache::Save(const string &path, uint64_t key, const FoliageCacheData &data)
+{
+    error_code ec;
+    filesystem::create_directories(filesystem::path(path).parent_path(), ec);
+
+    // Write beside the target and rename, so a crash never leaves a half-written cache
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out)
+        {
+            cerr << "  Could not write foliage cache: " << path << endl;
+            return false;
+        }
+
+        CacheHeader header;
+        header.magic = CACHE_MAGIC;
+        header.version = VERSION;
+        header.key = key;
+        header.seed = data.seed;
+        header.positionCount = (uint32_t)data.positions.size();
+        header.textureIndexCount = (uint32_t)data.textureIndices.size();
+        header.cellCount = (uint32_t)data.cells.size();
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(data.positions.data()), data.positions.size() * sizeof(glm::vec3));
+        out.write(reinterpret_cast<const char *>(data.textureIndices.data()), data.textureIndices.size() * sizeof(float));
+        out.write(reinterpret_cast<const char *>(data.cells.data()), data.cells.size() * sizeof(FoliageCell));
+        if (!out)
+            return false;
+    }
+
+    filesystem::rename(tempPath, path, ec);
+    return !ec;
+}
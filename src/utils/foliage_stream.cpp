@@ -0,0 +1,471 @@
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+#include "foliage_stream.h"
+#include "poisson_disk.h"
+
+// Where this kind may grow (slope limit from the foliage traits)
+static DensityRules streamDensityRules(FoliageType type, const FoliagePlacement &placement)
+{
+    DensityRules rules;
+    VisitFoliageTraits(type, [&rules](auto traits)
+    {
+        rules.minNormalY = decltype(traits)::minNormalY;
+    });
+    rules.exclusions = placement.exclusions;
+    return rules;
+}
+
+FoliageStream::FoliageStream(Terrain *terrain, FoliageType type, int count, float height, float width,
+                             const LODConfig &lodConfig, const FoliagePlacement &placement,
+                             const FoliageStreamSettings &settings)
+    : terrain(terrain), type(type), lodConfig(lodConfig), placement(placement), settings(settings),
+      densityMap(terrain, streamDensityRules(type, placement)), height(height), width(width)
+{
+    // Per-kind constants from the foliage traits
+    VisitFoliageTraits(type, [this](auto traits)
+    {
+        using Traits = decltype(traits);
+        typeName = Traits::name;
+        boundingRadius = Traits::boundingRadius;
+        hasTextureIndex = Traits::hasTextureIndex;
+        variantCount = Traits::variantCount;
+    });
+
+    cout << "Setting up streamed " << typeName << "..." << endl;
+
+    float terrainWidth = terrain->width * terrain->scale;
+    float terrainDepth = terrain->height * terrain->scale;
+    float cellSize = this->settings.cellSize;
+    gridOrigin = glm::vec2(-terrainWidth / 2.0f, -terrainDepth / 2.0f);
+    cellsX = max(1, (int)ceil(terrainWidth / cellSize));
+    cellsZ = max(1, (int)ceil(terrainDepth / cellSize));
+
+    // Same spacing a whole-terrain Poisson placement of `count` would use
+    spacing = placement.minSpacing;
+    if (spacing <= 0.0f)
+        spacing = sqrtf(0.7f * terrainWidth * terrainDepth / max(1, count));
+
+    if (this->settings.activationRadius <= 0.0f)
+        this->settings.activationRadius = lodConfig.farDistance + cellSize;
+    if (this->settings.evictionRadius <= this->settings.activationRadius)
+        this->settings.evictionRadius = this->settings.activationRadius * 1.25f;
+
+    // Enough slots for every cell that can intersect the eviction circle wherever the
+    // camera is inside its own cell: cells whose gap to the camera's cell is within
+    // the radius (the corners of the bounding square never qualify)
+    float reach = this->settings.evictionRadius / cellSize;
+    int cellsOut = (int)ceil(reach) + 1;
+    slotCount = 0;
+    for (int dz = -cellsOut; dz <= cellsOut; dz++)
+    {
+        for (int dx = -cellsOut; dx <= cellsOut; dx++)
+        {
+            float gapX = (float)max(abs(dx) - 1, 0);
+            float gapZ = (float)max(abs(dz) - 1, 0);
+            if (gapX * gapX + gapZ * gapZ <= reach * reach)
+                slotCount++;
+        }
+    }
+
+    // Each slot fits the densest possible cell. Samples are at least `spacing` apart,
+    // so discs of half that radius don't overlap inside the cell grown by half the
+    // spacing, and no packing of equal discs beats the hexagonal density pi / sqrt(12)
+    float packedArea = (cellSize + spacing) * (cellSize + spacing);
+    slotCapacity = (uint32_t)floor(packedArea * 2.0f / (sqrtf(3.0f) * spacing * spacing));
+    for (int s = slotCount - 1; s >= 0; s--)
+        freeSlots.push_back(s);
+
+    setupQuad();
+
+    glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, (size_t)slotCount * slotCapacity * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+    if (hasTextureIndex)
+    {
+        glGenBuffers(1, &textureIndexVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, textureIndexVBO);
+        glBufferData(GL_ARRAY_BUFFER, (size_t)slotCount * slotCapacity * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    int workerCount = this->settings.workerCount;
+    if (workerCount <= 0)
+        workerCount = max(1, (int)thread::hardware_concurrency() - 1);
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&FoliageStream::workerLoop, this);
+
+    cout << "  " << cellsX << "x" << cellsZ << " cells of " << cellSize << "m, "
+         << slotCount << " slots of " << slotCapacity << " instances ("
+         << (size_t)slotCount * slotCapacity * sizeof(glm::vec3) / 1024 << " KB), "
+         << workerCount << " workers" << endl;
+}
+
+FoliageStream::~FoliageStream()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+        jobQueue.clear();
+    }
+    queueReady.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteBuffers(1, &textureIndexVBO);
+}
+
+void FoliageStream::setupQuad()
+{
+    // Single billboard quad, same as Foliage
+    float halfWidth = width / 2.0f;
+    float vertices[] = {
+        -halfWidth, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+        halfWidth, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+        halfWidth, height, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
+        -halfWidth, height, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f};
+
+    unsigned int indices[] = {
+        0, 1, 2,
+        0, 2, 3};
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+
+    // Instance attributes, pointed at a slot per draw
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    if (hasTextureIndex)
+    {
+        glEnableVertexAttribArray(4);
+        glVertexAttribDivisor(4, 1);
+    }
+
+    glBindVertexArray(0);
+}
+
+// Distance from a point on the XZ plane to the nearest edge of a cell
+float FoliageStream::cellDistance(int cell, const glm::vec2 &point) const
+{
+    glm::vec2 minCorner = gridOrigin + glm::vec2((float)(cell % cellsX), (float)(cell / cellsX)) * settings.cellSize;
+    glm::vec2 nearest = glm::clamp(point, minCorner, minCorner + glm::vec2(settings.cellSize));
+    return glm::distance(point, nearest);
+}
+
+float FoliageStream::densityAt(const LODConfig &lod, float distance) const
+{
+    float density = 0.0f;
+    VisitFoliageTraits(type, [&](auto traits)
+    {
+        density = FoliageDensity(traits, lod, distance);
+    });
+    return density;
+}
+
+void FoliageStream::update(const Camera &camera)
+{
+    glm::vec2 cameraXZ(camera.Position.x, camera.Position.z);
+
+    // Evict cells the camera has left behind, their slots go back to the pool
+    for (auto it = resident.begin(); it != resident.end();)
+    {
+        if (cellDistance(it->first, cameraXZ) > settings.evictionRadius)
+        {
+            freeSlots.push_back(it->second.slot);
+            residentInstanceCount -= it->second.count;
+            evictedCount++;
+            it = resident.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // Upload cells the workers finished (GL calls stay on this thread)
+    vector<CellResult> finished;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        finished.swap(completed);
+
+        // Drop queued cells the camera moved away from before they were started
+        for (auto it = jobQueue.begin(); it != jobQueue.end();)
+        {
+            if (cellDistance(*it, cameraXZ) > settings.evictionRadius)
+            {
+                pending.erase(*it);
+                it = jobQueue.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for (auto &result : finished)
+    {
+        pending.erase(result.cell);
+        if (cellDistance(result.cell, cameraXZ) > settings.evictionRadius)
+            continue;
+        if (freeSlots.empty())
+        {
+            cerr << "FoliageStream: no free slot for " << typeName << " cell " << result.cell << endl;
+            continue;
+        }
+
+        ResidentCell cell;
+        cell.slot = freeSlots.back();
+        freeSlots.pop_back();
+        cell.count = static_cast<uint32_t>(result.positions.size());
+        cell.center = result.center;
+        cell.radius = result.radius;
+
+        if (cell.count > 0)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, (size_t)cell.slot * slotCapacity * sizeof(glm::vec3),
+                            cell.count * sizeof(glm::vec3), result.positions.data());
+            if (hasTextureIndex)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, textureIndexVBO);
+                glBufferSubData(GL_ARRAY_BUFFER, (size_t)cell.slot * slotCapacity * sizeof(float),
+                                cell.count * sizeof(float), result.textureIndices.data());
+            }
+        }
+
+        residentInstanceCount += cell.count;
+        resident[result.cell] = cell;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Request cells that came within the activation radius, nearest first
+    int reach = (int)ceil(settings.activationRadius / settings.cellSize);
+    int centerX = (int)floor((cameraXZ.x - gridOrigin.x) / settings.cellSize);
+    int centerZ = (int)floor((cameraXZ.y - gridOrigin.y) / settings.cellSize);
+
+    vector<pair<float, int>> requests;
+    for (int cz = max(0, centerZ - reach); cz <= min(cellsZ - 1, centerZ + reach); cz++)
+    {
+        for (int cx = max(0, centerX - reach); cx <= min(cellsX - 1, centerX + reach); cx++)
+        {
+            int cell = cz * cellsX + cx;
+            if (resident.count(cell) || pending.count(cell))
+                continue;
+
+            float distance = cellDistance(cell, cameraXZ);
+            if (distance <= settings.activationRadius)
+                requests.push_back(make_pair(distance, cell));
+        }
+    }
+
+    if (requests.empty())
+        return;
+
+    sort(requests.begin(), requests.end());
+    {
+        lock_guard<mutex> lock(queueMutex);
+        for (const auto &request : requests)
+        {
+            jobQueue.push_back(request.second);
+            pending.insert(request.second);
+        }
+    }
+    queueReady.notify_all();
+}
+
+void FoliageStream::workerLoop()
+{
+    while (true)
+    {
+        int cell;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [this]()
+                            { return stopping || !jobQueue.empty(); });
+            if (stopping)
+                return;
+            cell = jobQueue.front();
+            jobQueue.pop_front();
+        }
+
+        CellResult result = generateCell(cell);
+
+        lock_guard<mutex> lock(queueMutex);
+        completed.push_back(move(result));
+    }
+}
+
+// Runs on a worker thread: only reads the terrain and the density map
+FoliageStream::CellResult FoliageStream::generateCell(int cell) const
+{
+    int cx = cell % cellsX;
+    int cz = cell / cellsX;
+
+    CellResult result;
+    result.cell = cell;
+    result.center = glm::vec3(0.0f);
+    result.radius = 0.0f;
+
+    // Seed per cell, so a cell regenerates identically after eviction
+    uint32_t seed = HashCombine(HashCombine(HashCombine(placement.seed, static_cast<uint32_t>(type)), cx), cz);
+
+    PoissonDiskSettings poisson;
+    poisson.minCorner = gridOrigin + glm::vec2((float)cx, (float)cz) * settings.cellSize;
+    poisson.maxCorner = poisson.minCorner + glm::vec2(settings.cellSize);
+    poisson.minSpacing = spacing;
+    poisson.seed = seed;
+    poisson.tileCells = 1 << 16; // a single tile, this is already a worker thread
+
+    vector<glm::vec2> samples = GeneratePoissonDisk(poisson, [this](float x, float z)
+    {
+        return densityMap.Accept(x, z);
+    });
+    if (samples.empty())
+        return result;
+
+    // Shuffle so any prefix of the cell is an even thinning (drawn by LOD density)
+    PlacementRng rng(seed);
+    for (size_t i = samples.size() - 1; i > 0; i--)
+        swap(samples[i], samples[rng.NextUInt() % (i + 1)]);
+    if (samples.size() > slotCapacity)
+        samples.resize(slotCapacity);
+
+    glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+    result.positions.reserve(samples.size());
+    for (const auto &s : samples)
+    {
+        glm::vec3 position(s.x, terrain->getHeight(s.x, s.y), s.y);
+        result.positions.push_back(position);
+        minPos = glm::min(minPos, position);
+        maxPos = glm::max(maxPos, position);
+
+        if (hasTextureIndex)
+        {
+            // Even split between the kind's textures
+            int variant = min(variantCount - 1, (int)(rng.NextFloat() * variantCount));
+            result.textureIndices.push_back((float)variant);
+        }
+    }
+
+    result.center = (minPos + maxPos) * 0.5f;
+    result.radius = glm::length(maxPos - minPos) * 0.5f + boundingRadius;
+    return result;
+}
+
+void FoliageStream::Draw(Shader &shader, const Camera::Frustum &frustum, const Camera &camera)
+{
+    update(camera);
+
+    // Bands for the current projection (projected-size LOD)
+    const LODConfig lod = lodConfig.ForProjection(frustum.fovY, frustum.viewportHeight, boundingRadius);
+
+    visibleCount = 0;
+    visibleCells.clear();
+    visibleDepths.clear();
+    for (const auto &entry : resident)
+    {
+        const ResidentCell &cell = entry.second;
+        if (cell.count == 0)
+            continue;
+        if (!camera.IsSphereInFrustum(frustum, cell.center, cell.radius))
+            continue;
+
+        float nearest = max(0.0f, glm::distance(camera.Position, cell.center) - cell.radius);
+        if (nearest > lod.farDistance)
+            continue;
+
+        // Cells are shuffled, so a prefix thins them evenly
+        GLsizei instances = (GLsizei)min<float>((float)cell.count, ceil(cell.count * densityAt(lod, nearest)));
+        if (instances <= 0)
+            continue;
+
+        visibleCells.push_back({&cell, instances});
+        visibleDepths.push_back(DepthSorter::ViewDepth(cell.center, camera.Position, camera.Front));
+    }
+
+    // Per-cell draws in depth order (front-to-back for alpha-tested kinds)
+    if (depthOrder != DepthOrder::NONE)
+    {
+        depthSorter.Sort(visibleDepths.data(), visibleDepths.size(), settings.evictionRadius, depthOrder);
+        depthSorter.Apply(visibleCells);
+    }
+
+    if (prepass.Enabled())
+    {
+        DepthPrepass::BeginDepthPass();
+        submit(*prepass.depth);
+        DepthPrepass::BeginColourPass();
+        submit(*prepass.colour);
+        DepthPrepass::End();
+    }
+    else
+    {
+        submit(shader);
+    }
+
+    for (const auto &visible : visibleCells)
+        visibleCount += visible.instances;
+
+    // Debug output
+    static int frameCount = 0;
+    if (++frameCount % 60 == 0)
+    {
+        cout << typeName << " stream: " << resident.size() << " resident cells ("
+             << residentInstanceCount << " instances), " << pending.size() << " pending, "
+             << evictedCount << " evicted, rendering " << visibleCount
+             << ", depth sort " << depthSorter.GetLastSortMs() << " ms"
+             << (prepass.Enabled() ? ", depth prepass" : "") << endl;
+    }
+}
+
+void FoliageStream::submit(Shader &shader)
+{
+    shader.use();
+    shader.setBool("packedInstances", false);
+
+    glBindVertexArray(VAO);
+    for (const auto &visible : visibleCells)
+    {
+        const ResidentCell &cell = *visible.cell;
+
+        // No base instance on 3.3, point the instance attributes at this cell's slot
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3),
+                              (void *)((size_t)cell.slot * slotCapacity * sizeof(glm::vec3)));
+        if (hasTextureIndex)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, textureIndexVBO);
+            glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(float),
+                                  (void *)((size_t)cell.slot * slotCapacity * sizeof(float)));
+        }
+
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, visible.instances);
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,366 @@
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+using namespace std;
+
+#include "mesh_simplify.h"
+
+namespace
+{
+    // Symmetric 4x4 error quadric, upper triangle
+    struct Quadric
+    {
+        double q[10] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+        void AddPlane(const glm::vec3 &n, float d, double weight)
+        {
+            double a = n.x, b = n.y, c = n.z, e = d;
+            q[0] += weight * a * a;
+            q[1] += weight * a * b;
+            q[2] += weight * a * c;
+            q[3] += weight * a * e;
+            q[4] += weight * b * b;
+            q[5] += weight * b * c;
+            q[6] += weight * b * e;
+            q[7] += weight * c * c;
+            q[8] += weight * c * e;
+            q[9] += weight * e * e;
+        }
+
+        void Add(const Quadric &other)
+        {
+            for (int i = 0; i < 10; i++)
+                q[i] += other.q[i];
+        }
+
+        // v^T Q v with v = (p, 1)
+        double Error(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x +
+                   q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y +
+                   q[7] * z * z + 2.0 * q[8] * z + q[9];
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to; // welded vertices, `from` moves onto `to`
+        uint32_t fromStamp, toStamp;
+
+        bool operator>(const Collapse &other) const { return cost > other.cost; }
+    };
+
+    uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+    glm::vec3 faceNormal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    {
+        return glm::cross(b - a, c - a);
+    }
+}
+
+vector<vector<unsigned int>> SimplifyMesh(const vector<glm::vec3> &positions,
+                                          const vector<unsigned int> &indices,
+                                          const vector<float> &ratios)
+{
+    vector<vector<unsigned int>> lods;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || ratios.empty())
+        return lods;
+
+    // Weld vertices with bit-identical positions
+    vector<uint32_t> welded(positions.size());
+    vector<glm::vec3> points;
+    {
+        unordered_map<uint64_t, vector<uint32_t>> buckets;
+        for (uint32_t v = 0; v < positions.size(); v++)
+        {
+            uint32_t bits[3];
+            memcpy(bits, &positions[v], sizeof(bits));
+            uint64_t hash = ((uint64_t)bits[0] * 73856093u) ^ ((uint64_t)bits[1] * 19349663u) ^ ((uint64_t)bits[2] * 83492791u);
+
+            auto &bucket = buckets[hash];
+            uint32_t match = UINT32_MAX;
+            for (uint32_t candidate : bucket)
+            {
+                if (points[candidate] == positions[v])
+                {
+                    match = candidate;
+                    break;
+                }
+            }
+            if (match == UINT32_MAX)
+            {
+                match = (uint32_t)points.size();
+                points.push_back(positions[v]);
+                bucket.push_back(match);
+            }
+            welded[v] = match;
+        }
+    }
+
+    size_t pointCount = points.size();
+    vector<array<uint32_t, 3>> triangles(triangleCount); // welded corners
+    vector<array<uint32_t, 3>> corners(triangleCount);   // input vertex per corner
+    vector<bool> triangleAlive(triangleCount, true);
+    vector<vector<uint32_t>> pointTriangles(pointCount);
+    vector<Quadric> quadrics(pointCount);
+    unordered_map<uint64_t, int> edgeUse;
+    unordered_map<uint64_t, uint64_t> edgeCorners; // input vertices on a welded edge, first use
+    unordered_map<uint64_t, bool> edgeSeam;        // welded edge whose sides differ in attributes
+
+    size_t aliveCount = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            corners[t][k] = indices[t * 3 + k];
+            triangles[t][k] = welded[indices[t * 3 + k]];
+        }
+
+        const auto &tri = triangles[t];
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+        {
+            triangleAlive[t] = false;
+            continue;
+        }
+        aliveCount++;
+
+        // Area-weighted plane quadric on each corner
+        glm::vec3 n = faceNormal(points[tri[0]], points[tri[1]], points[tri[2]]);
+        float area = glm::length(n);
+        if (area > 0.0f)
+        {
+            n /= area;
+            float d = -glm::dot(n, points[tri[0]]);
+            for (int k = 0; k < 3; k++)
+                quadrics[tri[k]].AddPlane(n, d, area * 0.5);
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = tri[k], b = tri[(k + 1) % 3];
+            uint32_t ca = corners[t][k], cb = corners[t][(k + 1) % 3];
+            uint64_t key = edgeKey(a, b);
+            uint64_t pair = a < b ? ((uint64_t)ca << 32) | cb : ((uint64_t)cb << 32) | ca;
+
+            pointTriangles[a].push_back((uint32_t)t);
+            if (edgeUse[key]++ == 0)
+                edgeCorners[key] = pair;
+            else if (edgeCorners[key] != pair)
+                edgeSeam[key] = true;
+        }
+    }
+
+    // Open borders and UV/normal seams get a steep plane through the edge,
+    // perpendicular to the face, so silhouettes such as cut branch ends and the
+    // seam lines the attributes are split along survive
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (!triangleAlive[t])
+            continue;
+        const auto &tri = triangles[t];
+        glm::vec3 n = faceNormal(points[tri[0]], points[tri[1]], points[tri[2]]);
+        if (glm::length(n) <= 0.0f)
+            continue;
+        n = glm::normalize(n);
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = tri[k], b = tri[(k + 1) % 3];
+            uint64_t key = edgeKey(a, b);
+            if (edgeUse[key] != 1 && !edgeSeam.count(key))
+                continue;
+
+            glm::vec3 edge = points[b] - points[a];
+            float length = glm::length(edge);
+            if (length <= 0.0f)
+                continue;
+            glm::vec3 borderNormal = glm::normalize(glm::cross(edge, n));
+            float d = -glm::dot(borderNormal, points[a]);
+            double weight = 10.0 * length * length;
+            quadrics[a].AddPlane(borderNormal, d, weight);
+            quadrics[b].AddPlane(borderNormal, d, weight);
+        }
+    }
+
+    vector<uint32_t> stamp(pointCount, 0);
+    vector<bool> pointAlive(pointCount, true);
+    priority_queue<Collapse, vector<Collapse>, greater<Collapse>> heap;
+
+    // Cheaper direction of the edge (a, b)
+    auto pushEdge = [&](uint32_t a, uint32_t b)
+    {
+        Quadric combined = quadrics[a];
+        combined.Add(quadrics[b]);
+        double toB = combined.Error(points[b]);
+        double toA = combined.Error(points[a]);
+        if (toB <= toA)
+            heap.push({toB, a, b, stamp[a], stamp[b]});
+        else
+            heap.push({toA, b, a, stamp[b], stamp[a]});
+    };
+
+    for (const auto &entry : edgeUse)
+        pushEdge((uint32_t)(entry.first >> 32), (uint32_t)(entry.first & 0xffffffffu));
+
+    // Moving `from` onto `to` must not fold any remaining triangle over
+    auto flipsTriangle = [&](uint32_t from, uint32_t to)
+    {
+        for (uint32_t t : pointTriangles[from])
+        {
+            if (!triangleAlive[t])
+                continue;
+            const auto &tri = triangles[t];
+            if (tri[0] == to || tri[1] == to || tri[2] == to)
+                continue; // collapses away
+
+            glm::vec3 before[3], after[3];
+            for (int k = 0; k < 3; k++)
+            {
+                before[k] = points[tri[k]];
+                after[k] = tri[k] == from ? points[to] : points[tri[k]];
+            }
+            glm::vec3 oldNormal = faceNormal(before[0], before[1], before[2]);
+            glm::vec3 newNormal = faceNormal(after[0], after[1], after[2]);
+            float newArea = glm::length(newNormal);
+            if (newArea <= 1e-12f)
+                return true;
+            if (glm::dot(oldNormal, newNormal) < 0.2f * glm::length(oldNormal) * newArea)
+                return true;
+        }
+        return false;
+    };
+
+    // Which input vertex of `to` each input vertex of `from` becomes, read off the
+    // triangles on the collapsing edge so every corner stays in its own attribute
+    // wedge. Fails when a wedge around `from` doesn't touch the edge (it would take
+    // another wedge's UVs and normals) or touches it with two different partners
+    vector<pair<uint32_t, uint32_t>> wedges;
+    auto matchWedges = [&](uint32_t from, uint32_t to)
+    {
+        wedges.clear();
+        for (uint32_t t : pointTriangles[from])
+        {
+            if (!triangleAlive[t])
+                continue;
+            const auto &tri = triangles[t];
+            int kFrom = tri[0] == from ? 0 : tri[1] == from ? 1 : 2;
+            int kTo = tri[0] == to ? 0 : tri[1] == to ? 1 : tri[2] == to ? 2 : -1;
+            if (kTo < 0)
+                continue;
+
+            uint32_t source = corners[t][kFrom], target = corners[t][kTo];
+            auto found = find_if(wedges.begin(), wedges.end(),
+                                 [&](const pair<uint32_t, uint32_t> &w) { return w.first == source; });
+            if (found == wedges.end())
+                wedges.push_back({source, target});
+            else if (found->second != target)
+                return false;
+        }
+
+        for (uint32_t t : pointTriangles[from])
+        {
+            if (!triangleAlive[t])
+                continue;
+            const auto &tri = triangles[t];
+            uint32_t source = corners[t][tri[0] == from ? 0 : tri[1] == from ? 1 : 2];
+            if (none_of(wedges.begin(), wedges.end(),
+                        [&](const pair<uint32_t, uint32_t> &w) { return w.first == source; }))
+                return false;
+        }
+        return true;
+    };
+
+    auto emit = [&]()
+    {
+        vector<unsigned int> lod;
+        lod.reserve(aliveCount * 3);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (triangleAlive[t])
+                lod.insert(lod.end(), corners[t].begin(), corners[t].end());
+        }
+        lods.push_back(move(lod));
+    };
+
+    for (float ratio : ratios)
+    {
+        size_t target = (size_t)max(1.0f, ceil(triangleCount * ratio));
+
+        while (aliveCount > target && !heap.empty())
+        {
+            Collapse collapse = heap.top();
+            heap.pop();
+
+            uint32_t from = collapse.from, to = collapse.to;
+            if (!pointAlive[from] || !pointAlive[to] ||
+                stamp[from] != collapse.fromStamp || stamp[to] != collapse.toStamp)
+                continue; // stale entry
+            if (flipsTriangle(from, to) || !matchWedges(from, to))
+                continue;
+
+            // Apply: triangles on the edge vanish, the rest take `to` in place of `from`
+            pointAlive[from] = false;
+            quadrics[to].Add(quadrics[from]);
+            for (uint32_t t : pointTriangles[from])
+            {
+                if (!triangleAlive[t])
+                    continue;
+                auto &tri = triangles[t];
+                if (tri[0] == to || tri[1] == to || tri[2] == to)
+                {
+                    triangleAlive[t] = false;
+                    aliveCount--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    if (tri[k] == from)
+                    {
+                        tri[k] = to;
+                        for (const auto &w : wedges)
+                        {
+                            if (w.first == corners[t][k])
+                                corners[t][k] = w.second;
+                        }
+                    }
+                }
+                pointTriangles[to].push_back(t);
+            }
+            pointTriangles[from].clear();
+            stamp[to]++;
+
+            // Drop dead triangles and re-queue every edge around `to`
+            auto &around = pointTriangles[to];
+            around.erase(remove_if(around.begin(), around.end(),
+                                   [&](uint32_t t) { return !triangleAlive[t]; }),
+                         around.end());
+            for (uint32_t t : around)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t neighbour = triangles[t][k];
+                    if (neighbour != to)
+                        pushEdge(to, neighbour);
+                }
+            }
+        }
+
+        emit();
+    }
+
+    return lods;
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include "poisson_disk.h"
+#include "parallel_for.h"
+
+vector<glm::vec2> GeneratePoissonDisk(const PoissonDiskSettings &settings,
+                                      const PoissonAcceptFn &accept)
+{
+    // Background grid: cell diagonal == spacing, so each cell holds at most one sample
+    const float cellSize = settings.minSpacing / sqrtf(2.0f);
+    const glm::vec2 extent = settings.maxCorner - settings.minCorner;
+    const int gridW = max(1, (int)ceil(extent.x / cellSize));
+    const int gridH = max(1, (int)ceil(extent.y / cellSize));
+    const float spacingSq = settings.minSpacing * settings.minSpacing;
+
+    vector<glm::vec2> samples(gridW * gridH);
+    vector<uint8_t> occupied(gridW * gridH, 0);
+
+    // Tiles of the same phase (tx % 2, tz % 2) are a full tile apart, and a sample
+    // only looks 2 cells beyond its own, so same-phase tiles never touch each other
+    const int tileCells = max(3, settings.tileCells);
+    const int tilesX = (gridW + tileCells - 1) / tileCells;
+    const int tilesZ = (gridH + tileCells - 1) / tileCells;
+
+    auto processTile = [&](int tx, int tz)
+    {
+        // Each tile has its own stream so results don't depend on scheduling
+        PlacementRng rng(HashCombine(HashCombine(settings.seed, tx), tz));
+
+        int x0 = tx * tileCells, x1 = min(gridW, x0 + tileCells);
+        int z0 = tz * tileCells, z1 = min(gridH, z0 + tileCells);
+
+        for (int gz = z0; gz < z1; gz++)
+        {
+            for (int gx = x0; gx < x1; gx++)
+            {
+                for (int attempt = 0; attempt < settings.attemptsPerCell; attempt++)
+                {
+                    glm::vec2 candidate = settings.minCorner +
+                                          glm::vec2((gx + rng.NextFloat()) * cellSize,
+                                                    (gz + rng.NextFloat()) * cellSize);
+                    if (candidate.x >= settings.maxCorner.x || candidate.y >= settings.maxCorner.y)
+                        continue;
+
+                    // Spacing check against the 5x5 neighbourhood
+                    bool tooClose = false;
+                    for (int nz = max(0, gz - 2); nz <= min(gridH - 1, gz + 2) && !tooClose; nz++)
+                    {
+                        for (int nx = max(0, gx - 2); nx <= min(gridW - 1, gx + 2); nx++)
+                        {
+                            int n = nz * gridW + nx;
+                            if (!occupied[n])
+                                continue;
+                            glm::vec2 d = samples[n] - candidate;
+                            if (glm::dot(d, d) < spacingSq)
+                            {
+                                tooClose = true;
+                                break;
+                            }
+                        }
+                    }
+                    if (tooClose)
+                        continue;
+
+                    if (accept && !accept(candidate.x, candidate.y))
+                        continue;
+
+                    samples[gz * gridW + gx] = candidate;
+                    occupied[gz * gridW + gx] = 1;
+                    break;
+                }
+            }
+        }
+    };
+
+    for (int phase = 0; phase < 4; phase++)
+    {
+        vector<glm::ivec2> phaseTiles;
+        for (int tz = phase / 2; tz < tilesZ; tz += 2)
+            for (int tx = phase % 2; tx < tilesX; tx += 2)
+                phaseTiles.push_back(glm::ivec2(tx, tz));
+
+        ParallelFor(phaseTiles.size(), [&](size_t t) { processTile(phaseTiles[t].x, phaseTiles[t].y); });
+    }
+
+    // Gather in grid order (deterministic)
+    vector<glm::vec2> result;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (occupied[i])
+            result.push_back(samples[i]);
+    }
+    return result;
+}
@@ -0,0 +1,238 @@
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+#include "procedural_grass.h"
+#include "foliage_traits.h"
+#include "poisson_disk.h"
+
+ProceduralGrass::ProceduralGrass(Terrain *terrain, const LODConfig &lodConfig,
+                                 const ProceduralGrassSettings &settings)
+    : terrain(terrain), lodConfig(lodConfig), settings(settings)
+{
+    cout << "Setting up procedural grass..." << endl;
+
+    // Same rules the instanced grass uses for placement
+    DensityRules rules;
+    rules.minNormalY = GrassTraits::minNormalY;
+    rules.exclusions = settings.exclusions;
+    DensityMap densityMap(terrain, rules);
+
+    heightTexture = terrain->createHeightTexture();
+    densityTexture = densityMap.CreateTexture();
+
+    buildCells(densityMap);
+    setupQuad();
+
+    cout << "  " << cells.size() << " grass cells of " << settings.cellSize << "m, up to "
+         << settings.bladesPerCell << " blades each, no instance data" << endl;
+}
+
+ProceduralGrass::~ProceduralGrass()
+{
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteTextures(1, &heightTexture);
+    glDeleteTextures(1, &densityTexture);
+}
+
+void ProceduralGrass::buildCells(const DensityMap &densityMap)
+{
+    float terrainWidth = terrain->width * terrain->scale;
+    float terrainDepth = terrain->height * terrain->scale;
+    int cellsX = max(1, (int)ceil(terrainWidth / settings.cellSize));
+    int cellsZ = max(1, (int)ceil(terrainDepth / settings.cellSize));
+    float step = (float)terrain->scale;
+
+    for (int cz = 0; cz < cellsZ; cz++)
+    {
+        for (int cx = 0; cx < cellsX; cx++)
+        {
+            glm::vec2 origin(-terrainWidth / 2.0f + cx * settings.cellSize,
+                             -terrainDepth / 2.0f + cz * settings.cellSize);
+
+            // Height range and coverage on the terrain grid inside the cell
+            float minY = FLT_MAX, maxY = -FLT_MAX;
+            float coverage = 0.0f;
+            for (float z = origin.y; z <= origin.y + settings.cellSize; z += step)
+            {
+                for (float x = origin.x; x <= origin.x + settings.cellSize; x += step)
+                {
+                    float y = terrain->getHeight(x, z);
+                    minY = min(minY, y);
+                    maxY = max(maxY, y);
+                    coverage += densityMap.GetDensity(x, z);
+                }
+            }
+
+            // Nothing grows here, never draw it
+            if (coverage <= 0.0f)
+                continue;
+
+            Cell cell;
+            cell.origin = origin;
+            cell.center = glm::vec3(origin.x + settings.cellSize / 2.0f,
+                                    (minY + maxY + settings.bladeHeight) / 2.0f,
+                                    origin.y + settings.cellSize / 2.0f);
+            cell.radius = glm::length(glm::vec3(settings.cellSize / 2.0f,
+                                                (maxY + settings.bladeHeight - minY) / 2.0f,
+                                                settings.cellSize / 2.0f)) +
+                          settings.bladeWidth;
+            cell.seed = HashCombine(HashCombine(settings.seed, cx), cz);
+            cells.push_back(cell);
+        }
+    }
+
+    vector<BoundingSphere> spheres;
+    spheres.reserve(cells.size());
+    for (const Cell &cell : cells)
+        spheres.push_back({cell.center, cell.radius});
+    cellBVH.Build(spheres);
+}
+
+void ProceduralGrass::setupQuad()
+{
+    // Single billboard quad, same as the instanced grass
+    float halfWidth = settings.bladeWidth / 2.0f;
+    float vertices[] = {
+        -halfWidth, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+        halfWidth, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+        halfWidth, settings.bladeHeight, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
+        -halfWidth, settings.bladeHeight, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f};
+
+    unsigned int indices[] = {
+        0, 1, 2,
+        0, 2, 3};
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+
+    glBindVertexArray(0);
+}
+
+void ProceduralGrass::Draw(Shader &shader, const Camera::Frustum &frustum, const Camera &camera)
+{
+    // Bands for the current projection (projected-size LOD)
+    const LODConfig lod = lodConfig.ForProjection(frustum.fovY, frustum.viewportHeight, GrassTraits::boundingRadius);
+
+    // Density curve as a table, shared by the per-cell blade counts below and the shader
+    const FoliageDensityLUT lut = BuildFoliageDensityLUT(GrassTraits{}, lod);
+
+    visibleCellCount = 0;
+    submittedBladeCount = 0;
+    visibleCells.clear();
+    visibleBlades.clear();
+    visibleDepths.clear();
+
+    // Cells touching the frustum within the far distance, from the hierarchy
+    candidateCells.clear();
+    cellBVH.Cull(frustum, camera.Position, lod.farDistance, candidateCells);
+
+    for (uint32_t c : candidateCells)
+    {
+        const Cell &cell = cells[c];
+        float nearest = max(0.0f, glm::distance(camera.Position, cell.center) - cell.radius);
+        if (nearest > lod.farDistance)
+            continue;
+
+        // Blades are ordered along a low-discrepancy sequence, so drawing a prefix thins
+        // the cell evenly; the shader trims the rest per blade by its own distance
+        float density = lut.Sample(nearest);
+        int blades = (int)ceil(settings.bladesPerCell * density);
+        if (blades <= 0)
+            continue;
+
+        visibleCells.push_back(c);
+        visibleBlades.push_back(blades);
+        visibleDepths.push_back(DepthSorter::ViewDepth(cell.center, camera.Position, camera.Front));
+    }
+
+    // Nearest cells first so early-z rejects blades hidden behind them
+    if (depthOrder != DepthOrder::NONE)
+    {
+        depthSorter.Sort(visibleDepths.data(), visibleDepths.size(), lod.farDistance + settings.cellSize, depthOrder);
+        depthSorter.Apply(visibleCells);
+        depthSorter.Apply(visibleBlades);
+    }
+
+    if (prepass.Enabled())
+    {
+        DepthPrepass::BeginDepthPass();
+        submit(*prepass.depth, lut, lod.crossFade);
+        DepthPrepass::BeginColourPass();
+        submit(*prepass.colour, lut, lod.crossFade);
+        DepthPrepass::End();
+    }
+    else
+    {
+        submit(shader, lut, lod.crossFade);
+    }
+
+    visibleCellCount = (int)visibleCells.size();
+    for (int blades : visibleBlades)
+        submittedBladeCount += blades;
+
+    // Debug output
+    static int frameCount = 0;
+    if (++frameCount % 60 == 0)
+    {
+        cout << "procedural grass: " << visibleCellCount << " / " << cells.size() << " cells, "
+             << submittedBladeCount << " blades submitted, depth sort "
+             << depthSorter.GetLastSortMs() << " ms" << (prepass.Enabled() ? ", depth prepass" : "") << endl;
+    }
+}
+
+void ProceduralGrass::submit(Shader &shader, const FoliageDensityLUT &lut, float crossFade)
+{
+    shader.use();
+
+    // Terrain inputs (units 1 and 2, unit 0 is the grass texture)
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, heightTexture);
+    shader.setInt("heightMap", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, densityTexture);
+    shader.setInt("densityMap", 2);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setVec2("terrainSize", glm::vec2(terrain->width * terrain->scale, terrain->height * terrain->scale));
+    shader.setVec2("heightMapSize", glm::vec2(terrain->width, terrain->height));
+    shader.setFloat("terrainScale", (float)terrain->scale);
+    shader.setFloat("minNormalY", GrassTraits::minNormalY);
+    shader.setFloat("cellSize", settings.cellSize);
+    shader.setInt("bladesPerCell", settings.bladesPerCell);
+
+    shader.setFloatArray("lodDensity", lut.values, FoliageDensityLUT::SIZE + 1);
+    shader.setFloat("lodToIndex", lut.toIndex);
+    shader.setFloat("crossFade", crossFade);
+
+    glBindVertexArray(VAO);
+    for (size_t i = 0; i < visibleCells.size(); i++)
+    {
+        const Cell &cell = cells[visibleCells[i]];
+        shader.setVec2("cellOrigin", cell.origin);
+        shader.setInt("cellSeed", (int)cell.seed);
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, visibleBlades[i]);
+    }
+    glBindVertexArray(0);
+}
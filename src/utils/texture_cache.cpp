@@ -0,0 +1,158 @@
+#include <stb_image.h>
+
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+#include "texture_cache.h"
+
+map<string, unsigned int> TextureCache::textures;
+map<string, TextureCache::Image> TextureCache::images;
+bool TextureCache::batchOpen = false;
+
+unsigned int TextureCache::GetArray(const vector<string> &paths, const char *label)
+{
+    string key;
+    for (const auto &path : paths)
+        key += path + "\n";
+
+    auto found = textures.find(key);
+    if (found != textures.end())
+    {
+        cout << "  Reusing cached " << label << " array (" << paths.size() << " slices)" << endl;
+        return found->second;
+    }
+
+    unsigned int texture = loadArray(paths, label);
+    textures[key] = texture;
+
+    // The pixels live on the GPU now
+    if (!batchOpen)
+        images.clear();
+    return texture;
+}
+
+void TextureCache::BeginBatch()
+{
+    batchOpen = true;
+}
+
+void TextureCache::EndBatch()
+{
+    batchOpen = false;
+    images.clear();
+}
+
+void TextureCache::Clear()
+{
+    for (const auto &entry : textures)
+        glDeleteTextures(1, &entry.second);
+    textures.clear();
+    images.clear();
+}
+
+const TextureCache::Image &TextureCache::decode(const string &path, const char *label)
+{
+    auto found = images.find(path);
+    if (found != images.end())
+        return found->second;
+
+    Image &image = images[path];
+    int channels;
+    unsigned char *pixels = stbi_load(path.c_str(), &image.width, &image.height, &channels, 4);
+    if (!pixels)
+    {
+        cout << "Failed to load " << label << ": " << path << endl;
+        image.width = image.height = 0;
+        return image;
+    }
+
+    image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * 4);
+    stbi_image_free(pixels);
+    return image;
+}
+
+unsigned int TextureCache::loadArray(const vector<string> &paths, const char *label)
+{
+    // Decode (or reuse) everything first, the first texture that loads fixes the array resolution
+    vector<const Image *> slices(paths.size(), nullptr);
+    int arrayWidth = 0, arrayHeight = 0;
+
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        if (paths[i].empty())
+            continue;
+
+        const Image &image = decode(paths[i], label);
+        if (image.pixels.empty())
+            continue;
+        slices[i] = &image;
+
+        if (arrayWidth == 0)
+        {
+            arrayWidth = image.width;
+            arrayHeight = image.height;
+        }
+    }
+
+    if (arrayWidth == 0)
+    {
+        arrayWidth = 1;
+        arrayHeight = 1;
+    }
+
+    int sliceCount = max(1, (int)paths.size());
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, arrayWidth, arrayHeight, sliceCount,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    vector<unsigned char> slice(arrayWidth * arrayHeight * 4);
+    for (int i = 0; i < sliceCount; i++)
+    {
+        const unsigned char *pixels = slice.data();
+        const Image *image = i < (int)slices.size() ? slices[i] : nullptr;
+
+        if (!image)
+        {
+            // Missing textures stay fully transparent, so whatever uses them is simply invisible
+            fill(slice.begin(), slice.end(), 0);
+        }
+        else if (image->width == arrayWidth && image->height == arrayHeight)
+        {
+            pixels = image->pixels.data();
+        }
+        else
+        {
+            // Slices share one resolution - nearest-neighbour resample the odd ones out
+            cout << "  Resampling " << paths[i] << " (" << image->width << "x" << image->height
+                 << ") to " << arrayWidth << "x" << arrayHeight << endl;
+            for (int y = 0; y < arrayHeight; y++)
+            {
+                int sy = y * image->height / arrayHeight;
+                for (int x = 0; x < arrayWidth; x++)
+                {
+                    int sx = x * image->width / arrayWidth;
+                    for (int c = 0; c < 4; c++)
+                        slice[(y * arrayWidth + x) * 4 + c] = image->pixels[(sy * image->width + sx) * 4 + c];
+                }
+            }
+        }
+
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, arrayWidth, arrayHeight, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    cout << "  " << label << " array: " << sliceCount << " slices of "
+         << arrayWidth << "x" << arrayHeight << endl;
+    return texture;
+}
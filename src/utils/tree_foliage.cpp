@@ -1,8 +1,28 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
 #include <random>
 using namespace std;
 
 #include "model.h"
 #include "tree_foliage.h"
+#include "texture_cache.h"
+
+// Branch LODs kept per mesh, as fractions of the full triangle count: mid trees
+// (LOD level 1) draw the first, far ones (level 2) the second, but only while no
+// impostors are set, otherwise those are drawn as impostors
+static const vector<float> branchLodRatios = {0.1f, 0.03f};
+
+// Share of each tree's leaves drawn per LOD level; the kept leaves grow by
+// 1/sqrt(fraction) so the crown covers about the same area
+static const float leafLodFractions[] = {1.0f, 0.5f, 0.25f};
+static const int leafLodCount = sizeof(leafLodFractions) / sizeof(leafLodFractions[0]);
+
+static float leafLodFraction(int lod)
+{
+    return leafLodFractions[max(0, min(lod, leafLodCount - 1))];
+}
 
 TreeFoliage::TreeFoliage(const char *branchModelPath)
 {
@@ -10,55 +30,80 @@ TreeFoliage::TreeFoliage(const char *branchModelPath)
     branchModel = new Model(branchModelPath);
     extractBranchVertices();
     std::cout << "  Extracted " << branchVertices.size() << " branch vertices" << std::endl;
-    setupQuadMesh();
-    std::cout << "  Quad mesh setup complete" << std::endl;
+    branchModel->GenerateLODs(branchLodRatios);
+    setupBranches();
+}
+
+TreeFoliage::TreeFoliage(const GeneratedTree &tree)
+{
+    std::cout << "Building procedural tree: " << tree.vertices.size() << " vertices, "
+              << tree.leafAnchors.size() << " leaf anchors" << std::endl;
+    branchModel = new Model(vector<Mesh>{Mesh(tree.vertices, tree.indices, {})});
+    branchModel->meshes[0].SetLODs(tree.lods);
+    extractBranchVertices();
+    leafAnchors = tree.leafAnchors;
+    setupBranches();
+}
+
+void TreeFoliage::setupBranches()
+{
+    std::cout << "  Branch LOD triangles:";
+    for (int lod = 0; lod < branchModel->GetLODCount(); lod++)
+        std::cout << " " << branchModel->GetTriangleCount(lod);
+    std::cout << std::endl;
+    setupLeafMesh();
+    setupInstanceBuffer();
+    std::cout << "  Leaf mesh and instance buffer setup complete" << std::endl;
 }
 
 TreeFoliage::~TreeFoliage()
 {
     delete branchModel;
-    glDeleteVertexArrays(1, &quadVAO);
-    glDeleteBuffers(1, &quadVBO);
-    glDeleteBuffers(1, &quadEBO);
+    glDeleteVertexArrays(1, &leafVAO);
+    glDeleteBuffers(1, &leafVBO);
+    glDeleteBuffers(1, &leafEBO);
     glDeleteBuffers(1, &instanceVBO);
-    for (auto tex : leafTextures)
-        glDeleteTextures(1, &tex);
 }
 
-void TreeFoliage::setupQuadMesh()
+void TreeFoliage::setupLeafMesh()
 {
-    // Single quad (2 triangles) - will be instanced
-    float quadVertices[] = {
-        // pos           // uv
-        -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f, 1.0f, 0.0f,
-        0.5f, 0.5f, 1.0f, 1.0f,
-        -0.5f, 0.5f, 0.0f, 1.0f};
-    unsigned int indices[] = {0, 1, 2, 2, 3, 0};
-
-    glGenVertexArrays(1, &quadVAO);
-    glGenBuffers(1, &quadVBO);
-    glGenBuffers(1, &quadEBO);
-    glGenBuffers(1, &instanceVBO);
-
-    glBindVertexArray(quadVAO);
-
-    // Quad geometry
-    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    // Filled by GenerateLeafClusters, one quad per leaf
+    glGenVertexArrays(1, &leafVAO);
+    glGenBuffers(1, &leafVBO);
+    glGenBuffers(1, &leafEBO);
+}
 
-    // Attribute 0: position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
-    // Attribute 1: uv
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
+void TreeFoliage::setupInstanceBuffer()
+{
+    glGenBuffers(1, &instanceVBO);
 
+    // Branch meshes read the same per-tree instances as the leaves
+    for (auto &mesh : branchModel->meshes)
+    {
+        glBindVertexArray(mesh.VAO);
+        BindTreeInstanceAttributes(instanceVBO);
+    }
     glBindVertexArray(0);
 }
 
+void BindTreeInstanceAttributes(unsigned int buffer, GLsizei firstInstance)
+{
+    // Attributes 7-10: model matrix columns, 11: LOD dither (on the bound VAO)
+    size_t base = firstInstance * sizeof(TreeDrawInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(7 + column);
+        glVertexAttribPointer(7 + column, 4, GL_FLOAT, GL_FALSE, sizeof(TreeDrawInstance),
+                              (void *)(base + offsetof(TreeDrawInstance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(7 + column, 1);
+    }
+    glEnableVertexAttribArray(11);
+    glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, sizeof(TreeDrawInstance),
+                          (void *)(base + offsetof(TreeDrawInstance, lodDither)));
+    glVertexAttribDivisor(11, 1);
+}
+
 void TreeFoliage::extractBranchVertices()
 {
     // Extract vertex positions from branch model for clustering
@@ -71,7 +116,56 @@ void TreeFoliage::extractBranchVertices()
     }
 }
 
+void TreeFoliage::computeBounds(const vector<size_t> &leafOrder)
+{
+    if (branchVertices.empty())
+        return;
+
+    glm::vec3 minPos = branchVertices[0], maxPos = branchVertices[0];
+    for (const auto &vertex : branchVertices)
+    {
+        minPos = glm::min(minPos, vertex);
+        maxPos = glm::max(maxPos, vertex);
+    }
+    for (size_t p = 0; p < leafOrder.size(); p++)
+    {
+        // Leaves reach half a scaled quad diagonal past their centre, enlarged as in
+        // the coarsest LOD whose prefix still holds them (most never reach the last)
+        int coarsest = 0;
+        while (coarsest + 1 < leafLodCount && (GLsizei)(p * 6) < leafPrefixCount(coarsest + 1))
+            coarsest++;
+        float reach = 0.71f / sqrt(leafLodFraction(coarsest));
+
+        // Every cluster holds the same number of leaves, in order
+        size_t i = leafOrder[p];
+        const LeafCluster &cluster = clusters[i / clusters[0].leafCount];
+        glm::vec3 leafPos = cluster.attachPoint + allLeaves[i].offset;
+        minPos = glm::min(minPos, leafPos - glm::vec3(allLeaves[i].scale * reach));
+        maxPos = glm::max(maxPos, leafPos + glm::vec3(allLeaves[i].scale * reach));
+    }
+
+    // Sphere around the box, plus room for the wind sway
+    boundsCenter = (minPos + maxPos) * 0.5f;
+    boundsRadius = glm::length(maxPos - minPos) * 0.5f + 0.2f;
+}
+
 void TreeFoliage::GenerateLeafClusters(int clustersPerBranch, int leavesPerCluster)
+{
+    vector<glm::vec3> attachPoints;
+    int step = max(1, (int)branchVertices.size() / max(1, clustersPerBranch));
+    for (size_t i = 0; i < branchVertices.size(); i += step)
+        attachPoints.push_back(branchVertices[i]);
+    buildLeafClusters(attachPoints, leavesPerCluster);
+}
+
+void TreeFoliage::GenerateLeafClustersOnAnchors(int leavesPerCluster)
+{
+    if (leafAnchors.empty())
+        std::cout << "  No leaf anchors on this tree, it gets no leaves" << std::endl;
+    buildLeafClusters(leafAnchors, leavesPerCluster);
+}
+
+void TreeFoliage::buildLeafClusters(const vector<glm::vec3> &attachPoints, int leavesPerCluster)
 {
     mt19937 rng(42); // Fixed seed for consistency
     uniform_real_distribution<float> dist01(0.0f, 1.0f);
@@ -81,12 +175,10 @@ void TreeFoliage::GenerateLeafClusters(int clustersPerBranch, int leavesPerClust
     clusters.clear();
     allLeaves.clear();
 
-    // Sample branch vertices for cluster attachment points
-    int step = max(1, (int)branchVertices.size() / clustersPerBranch);
-    for (size_t i = 0; i < branchVertices.size(); i += step)
+    for (const glm::vec3 &attachPoint : attachPoints)
     {
         LeafCluster cluster;
-        cluster.attachPoint = branchVertices[i];
+        cluster.attachPoint = attachPoint;
         cluster.radius = 0.8f + dist01(rng) * 0.4f; // 0.8-1.2 units
         cluster.leafCount = leavesPerCluster;
 
@@ -123,144 +215,287 @@ void TreeFoliage::GenerateLeafClusters(int clustersPerBranch, int leavesPerClust
         }
     }
 
-    // Upload instance data to GPU
-    vector<float> instanceData;
-    for (size_t i = 0; i < clusters.size(); i++)
+    // Expand every leaf into its own quad so one draw covers the whole crown;
+    // the tree is the instance
+    static const float quadCorners[4][4] = {
+        // pos           // uv
+        {-0.5f, -0.5f, 0.0f, 0.0f},
+        {0.5f, -0.5f, 1.0f, 0.0f},
+        {0.5f, 0.5f, 1.0f, 1.0f},
+        {-0.5f, 0.5f, 0.0f, 1.0f}};
+
+    vector<float> vertexData;
+    vector<unsigned int> indices;
+    vector<size_t> leafOrder = orderLeavesByImportance(rng);
+    for (size_t idx : leafOrder)
     {
-        for (int j = 0; j < clusters[i].leafCount; j++)
+        LeafInstance &leaf = allLeaves[idx];
+        glm::vec3 worldPos = clusters[idx / leavesPerCluster].attachPoint + leaf.offset;
+
+        // Pack per corner: quadPos(2), uv(2), worldPos(3), customNormal(3), scale(1), texIndex(1)
+        unsigned int base = vertexData.size() / 12;
+        for (const auto &corner : quadCorners)
         {
-            int idx = i * leavesPerCluster + j;
-            if (idx >= allLeaves.size())
-                break;
-
-            LeafInstance &leaf = allLeaves[idx];
-            glm::vec3 worldPos = clusters[i].attachPoint + leaf.offset;
-
-            // Pack: worldPos(3), customNormal(3), scale(1), texIndex(1)
-            instanceData.push_back(worldPos.x);
-            instanceData.push_back(worldPos.y);
-            instanceData.push_back(worldPos.z);
-            instanceData.push_back(leaf.customNormal.x);
-            instanceData.push_back(leaf.customNormal.y);
-            instanceData.push_back(leaf.customNormal.z);
-            instanceData.push_back(leaf.scale);
-            instanceData.push_back((float)leaf.textureIndex);
+            vertexData.insert(vertexData.end(), corner, corner + 4);
+            vertexData.push_back(worldPos.x);
+            vertexData.push_back(worldPos.y);
+            vertexData.push_back(worldPos.z);
+            vertexData.push_back(leaf.customNormal.x);
+            vertexData.push_back(leaf.customNormal.y);
+            vertexData.push_back(leaf.customNormal.z);
+            vertexData.push_back(leaf.scale);
+            vertexData.push_back((float)leaf.textureIndex);
         }
+        for (unsigned int corner : {0u, 1u, 2u, 2u, 3u, 0u})
+            indices.push_back(base + corner);
     }
+    leafIndexCount = (GLsizei)indices.size();
 
-    glBindVertexArray(quadVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(float),
-                 instanceData.data(), GL_STATIC_DRAW);
+    glBindVertexArray(leafVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, leafVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float),
+                 vertexData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, leafEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+                 indices.data(), GL_STATIC_DRAW);
+
+    int stride = 12 * sizeof(float);
 
-    // Instance attributes (per-instance, not per-vertex)
-    int stride = 8 * sizeof(float);
+    // Attribute 0: quad corner
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void *)0);
+
+    // Attribute 1: uv
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(2 * sizeof(float)));
 
-    // Attribute 2: worldPos
+    // Attribute 2: worldPos (tree space)
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
-    glVertexAttribDivisor(2, 1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void *)(4 * sizeof(float)));
 
     // Attribute 3: customNormal
     glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
-    glVertexAttribDivisor(3, 1);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void *)(7 * sizeof(float)));
 
     // Attribute 4: scale
     glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
-    glVertexAttribDivisor(4, 1);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride, (void *)(10 * sizeof(float)));
 
     // Attribute 5: texIndex
     glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, stride, (void *)(7 * sizeof(float)));
-    glVertexAttribDivisor(5, 1);
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, stride, (void *)(11 * sizeof(float)));
+
+    // Attributes 7-11: per tree
+    BindTreeInstanceAttributes(instanceVBO);
 
     glBindVertexArray(0);
 
+    computeBounds(leafOrder);
+
     std::cout << "Generated " << clusters.size() << " leaf clusters with "
               << allLeaves.size() << " total leaves" << std::endl;
 }
 
-void TreeFoliage::LoadLeafTextures(const std::vector<const char *> &texturePaths)
+vector<size_t> TreeFoliage::orderLeavesByImportance(mt19937 &rng) const
 {
-    for (auto path : texturePaths)
+    // Weighted random rank within each cluster (key u^(1/w), highest first): big
+    // leaves on the cluster's outside shape its silhouette and are kept longest
+    uniform_real_distribution<float> dist01(0.0f, 1.0f);
+    vector<vector<pair<float, size_t>>> ranked(clusters.size());
+    for (size_t i = 0; i < allLeaves.size(); i++)
     {
-        // Load texture directly (path is already full)
-        unsigned int tex;
-        glGenTextures(1, &tex);
-
-        int width, height, nrComponents;
-        unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
+        size_t c = i / clusters[0].leafCount;
+        const LeafInstance &leaf = allLeaves[i];
+        float outside = glm::length(leaf.offset) / clusters[c].radius;
+        float weight = leaf.scale * leaf.scale * (0.25f + outside);
+        float key = pow(max(dist01(rng), 1e-6f), 1.0f / weight);
+        ranked[c].push_back({key, i});
+    }
+    for (auto &cluster : ranked)
+        sort(cluster.begin(), cluster.end(), greater<pair<float, size_t>>());
 
-        if (data)
+    // Round-robin over the clusters so every prefix still covers the whole crown
+    vector<size_t> order;
+    order.reserve(allLeaves.size());
+    for (size_t rank = 0; order.size() < allLeaves.size(); rank++)
+    {
+        for (const auto &cluster : ranked)
         {
-            GLenum format;
-            if (nrComponents == 1)
-                format = GL_RED;
-            else if (nrComponents == 3)
-                format = GL_RGB;
-            else if (nrComponents == 4)
-                format = GL_RGBA;
-
-            glBindTexture(GL_TEXTURE_2D, tex);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            stbi_image_free(data);
-            std::cout << "Loaded leaf texture: " << path << " (" << width << "x" << height << ")" << std::endl;
+            if (rank < cluster.size())
+                order.push_back(cluster[rank].second);
         }
-        else
+    }
+    return order;
+}
+
+GLsizei TreeFoliage::leafPrefixCount(int lod) const
+{
+    GLsizei leaves = leafIndexCount / 6;
+    GLsizei kept = (GLsizei)ceil(leaves * leafLodFraction(lod));
+    return max((GLsizei)1, min(kept, leaves)) * 6;
+}
+
+void TreeFoliage::LoadLeafTextures(const std::vector<const char *> &texturePaths)
+{
+    // One array for all variants (indexed by the leaf's texIndex), shared with every
+    // other tree type using the same files
+    leafTextureArray = TextureCache::GetArray(vector<string>(texturePaths.begin(), texturePaths.end()),
+                                              "leaf texture");
+}
+
+void TreeFoliage::SetInstances(const vector<TreeDrawInstance> &instances, const vector<int> &lods,
+                               const vector<int> &segments)
+{
+    instanceCount = (GLsizei)instances.size();
+    lodRanges.clear();
+    segmentRanges.clear();
+    if (instances.empty())
+        return;
+
+    const vector<TreeDrawInstance> *upload = &instances;
+    if (lods.empty() && segments.empty())
+    {
+        lodRanges.push_back({0, instanceCount, 0, -1});
+    }
+    else
+    {
+        // Each segment's run on its own, stable grouping by LOD (coarsest first) inside it
+        groupedInstances.clear();
+        size_t runStart = 0;
+        while (runStart < instances.size())
         {
-            std::cerr << "Failed to load leaf texture: " << path << std::endl;
+            int segment = segments.empty() ? -1 : segments[runStart];
+            size_t runEnd = runStart + 1;
+            while (runEnd < instances.size() && !segments.empty() && segments[runEnd] == segment)
+                runEnd++;
+
+            size_t firstRange = lodRanges.size();
+            int coarsest = lods.empty() ? 0 : *max_element(lods.begin() + runStart, lods.begin() + runEnd);
+            for (int lod = coarsest; lod >= 0; lod--)
+            {
+                GLsizei first = (GLsizei)groupedInstances.size();
+                for (size_t i = runStart; i < runEnd; i++)
+                {
+                    if (lods.empty() || lods[i] == lod)
+                        groupedInstances.push_back(instances[i]);
+                }
+                if ((GLsizei)groupedInstances.size() > first)
+                    lodRanges.push_back({first, (GLsizei)groupedInstances.size() - first, lod, segment});
+            }
+            if (segment >= 0)
+                segmentRanges[segment] = {firstRange, lodRanges.size()};
+            runStart = runEnd;
         }
+        upload = &groupedInstances;
+    }
+
+    // Grow-only, a handful of trees per type so a full re-upload is cheap
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (upload->size() > instanceCapacity)
+    {
+        instanceCapacity = upload->size() * 2;
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(TreeDrawInstance), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, upload->size() * sizeof(TreeDrawInstance), upload->data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TreeFoliage::Draw(Shader &leafShader, Shader &branchShader, const glm::mat4 &view,
+                       const glm::mat4 &projection, const glm::vec3 &cameraPos, int segment)
+{
+    DrawBranches(branchShader, view, projection, cameraPos, segment);
+    DrawLeaves(leafShader, view, projection, cameraPos, segment);
+}
 
-        leafTextures.push_back(tex);
+bool TreeFoliage::rangesOf(int segment, size_t &begin, size_t &end) const
+{
+    if (segment < 0)
+    {
+        begin = 0;
+        end = lodRanges.size();
+        return end > 0;
     }
+
+    auto found = segmentRanges.find(segment);
+    if (found == segmentRanges.end())
+        return false;
+    begin = found->second.first;
+    end = found->second.second;
+    return true;
 }
 
-void TreeFoliage::Draw(Shader &leafShader, Shader &branchShader,
-                       const glm::mat4 &model, const glm::mat4 &view,
-                       const glm::mat4 &projection, const glm::vec3 &cameraPos)
+void TreeFoliage::DrawBranches(Shader &branchShader, const glm::mat4 &view,
+                               const glm::mat4 &projection, const glm::vec3 &cameraPos, int segment)
 {
+    size_t rangeBegin, rangeEnd;
+    if (instanceCount == 0 || !rangesOf(segment, rangeBegin, rangeEnd))
+        return;
+
     // === DRAW BRANCHES (solid geometry, opaque) ===
     branchShader.use();
-    branchShader.setMat4("model", model);
     branchShader.setMat4("view", view);
     branchShader.setMat4("projection", projection);
     branchShader.setVec3("viewPos", cameraPos);
     branchShader.setVec3("lightDir", glm::vec3(0.3f, -0.7f, 0.5f)); // Match your scene lighting
 
-    branchModel->Draw(branchShader);
+    for (size_t r = rangeBegin; r < rangeEnd; r++)
+    {
+        const LODRange &range = lodRanges[r];
+        for (auto &mesh : branchModel->meshes)
+        {
+            glBindVertexArray(mesh.VAO);
+            BindTreeInstanceAttributes(instanceVBO, range.first);
+        }
+        branchModel->Draw(branchShader, range.count, range.lod);
+    }
+    glBindVertexArray(0);
+}
+
+size_t TreeFoliage::GetBranchTriangleCount() const
+{
+    size_t count = 0;
+    for (const LODRange &range : lodRanges)
+        count += range.count * branchModel->GetTriangleCount(range.lod);
+    return count;
+}
+
+size_t TreeFoliage::GetLeafCount() const
+{
+    size_t count = 0;
+    for (const LODRange &range : lodRanges)
+        count += range.count * (leafPrefixCount(range.lod) / 6);
+    return count;
+}
+
+void TreeFoliage::DrawLeaves(Shader &leafShader, const glm::mat4 &view,
+                             const glm::mat4 &projection, const glm::vec3 &cameraPos, int segment)
+{
+    size_t rangeBegin, rangeEnd;
+    if (instanceCount == 0 || !rangesOf(segment, rangeBegin, rangeEnd))
+        return;
 
     // === DRAW LEAVES (billboarded, transparent) ===
     leafShader.use();
-    leafShader.setMat4("model", model);
     leafShader.setMat4("view", view);
     leafShader.setMat4("projection", projection);
     leafShader.setVec3("cameraPos", cameraPos);
     leafShader.setVec3("cameraRight", glm::vec3(view[0][0], view[1][0], view[2][0]));
     leafShader.setVec3("cameraUp", glm::vec3(view[0][1], view[1][1], view[2][1]));
 
-    // Bind all leaf textures
-    for (size_t i = 0; i < leafTextures.size(); i++)
+    // Every leaf variant in one array
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, leafTextureArray);
+    leafShader.setInt("leafTextures", 0);
+
+    // Blend state is the caller's (TreeManager blends, the impostor bake doesn't)
+    glBindVertexArray(leafVAO);
+    for (size_t r = rangeBegin; r < rangeEnd; r++)
     {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, leafTextures[i]);
-        leafShader.setInt(("leafTexture" + std::to_string(i)).c_str(), i);
+        const LODRange &range = lodRanges[r];
+        // Most important leaves only, enlarged to fill the gaps
+        leafShader.setFloat("leafScale", 1.0f / sqrt(leafLodFraction(range.lod)));
+        BindTreeInstanceAttributes(instanceVBO, range.first);
+        glDrawElementsInstanced(GL_TRIANGLES, leafPrefixCount(range.lod), GL_UNSIGNED_INT, 0, range.count);
     }
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    glBindVertexArray(quadVAO);
-    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, allLeaves.size());
     glBindVertexArray(0);
-
-    glDisable(GL_BLEND);
-}
\ No newline at end of file
+}
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include "tree_generator.h"
+#include "poisson_disk.h"
+#include "parallel_for.h"
+
+// One emitted branch: rings * radial vertices from firstVertex, ring by ring
+struct BranchTube
+{
+    uint32_t firstVertex;
+    int rings;
+    int level;
+};
+
+struct BranchGrowth
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float length;
+    float radius;
+    int level;
+};
+
+struct GrowContext
+{
+    const TreeSpecies &species;
+    int radial;
+    PlacementRng rng;
+    GeneratedTree &tree;
+    vector<BranchTube> tubes;
+};
+
+static float signedRandom(PlacementRng &rng)
+{
+    return rng.NextFloat() * 2.0f - 1.0f;
+}
+
+static glm::vec3 perpendicular(const glm::vec3 &v)
+{
+    glm::vec3 axis = fabs(v.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    return glm::normalize(glm::cross(v, axis));
+}
+
+static void growBranch(GrowContext &context, const BranchGrowth &branch)
+{
+    const TreeSpecies &species = context.species;
+    const int segments = max(2, species.segments - branch.level);
+    const float segmentLength = branch.length / segments;
+
+    // Centre line, bent at random and pulled up a little every segment
+    vector<glm::vec3> centers(segments + 1);
+    vector<glm::vec3> segmentDirections(segments);
+    vector<float> radii(segments + 1);
+    glm::vec3 direction = branch.direction;
+    centers[0] = branch.origin;
+    for (int i = 0; i < segments; i++)
+    {
+        segmentDirections[i] = direction;
+        centers[i + 1] = centers[i] + direction * segmentLength;
+
+        glm::vec3 wobble(signedRandom(context.rng), signedRandom(context.rng), signedRandom(context.rng));
+        glm::vec3 bent = direction + wobble * species.bend + glm::vec3(0.0f, species.upwardPull, 0.0f);
+        if (glm::dot(bent, bent) > 1e-6f)
+            direction = glm::normalize(bent);
+    }
+    for (int i = 0; i <= segments; i++)
+        radii[i] = branch.radius * (1.0f + (species.tipTaper - 1.0f) * (float)i / segments);
+
+    // Rings face the mean of the segments they join
+    vector<glm::vec3> ringDirections(segments + 1);
+    ringDirections[0] = segmentDirections[0];
+    ringDirections[segments] = segmentDirections[segments - 1];
+    for (int i = 1; i < segments; i++)
+        ringDirections[i] = glm::normalize(segmentDirections[i - 1] + segmentDirections[i]);
+
+    // Rings with a parallel-transported frame, so the tube does not twist
+    context.tubes.push_back({(uint32_t)context.tree.vertices.size(), segments + 1, branch.level});
+    glm::vec3 side = perpendicular(ringDirections[0]);
+    for (int i = 0; i <= segments; i++)
+    {
+        const glm::vec3 &axis = ringDirections[i];
+        glm::vec3 transported = side - axis * glm::dot(side, axis);
+        side = glm::dot(transported, transported) > 1e-6f ? glm::normalize(transported) : perpendicular(axis);
+        glm::vec3 up = glm::cross(axis, side);
+
+        for (int j = 0; j < context.radial; j++)
+        {
+            float angle = glm::two_pi<float>() * j / context.radial;
+            glm::vec3 normal = cos(angle) * side + sin(angle) * up;
+
+            Vertex vertex = {};
+            vertex.Position = centers[i] + normal * radii[i];
+            vertex.Normal = normal;
+            vertex.TexCoords = glm::vec2((float)j / context.radial, i * segmentLength / (glm::two_pi<float>() * branch.radius));
+            vertex.Tangent = axis;
+            vertex.Bitangent = glm::cross(normal, axis);
+            context.tree.vertices.push_back(vertex);
+        }
+    }
+
+    auto pointAt = [&](float t, glm::vec3 &point, glm::vec3 &axis, float &radius)
+    {
+        float s = t * segments;
+        int i = min((int)s, segments - 1);
+        float f = s - i;
+        point = glm::mix(centers[i], centers[i + 1], f);
+        axis = segmentDirections[i];
+        radius = radii[i] + (radii[i + 1] - radii[i]) * f;
+    };
+
+    if (branch.level >= species.levels)
+    {
+        // Twig: leaf clusters at the tip and further down
+        int anchors = max(1, species.leafAnchorsPerTwig);
+        for (int a = 0; a < anchors; a++)
+        {
+            glm::vec3 point, axis;
+            float radius;
+            pointAt(1.0f - 0.5f * a / anchors, point, axis, radius);
+            context.tree.leafAnchors.push_back(point);
+        }
+        return;
+    }
+
+    // Children between childStart and the tip, spread around at the golden angle
+    int childCount = max(1, species.childrenPerBranch + (int)(context.rng.NextUInt() % 3) - 1);
+    float azimuthOffset = context.rng.NextFloat() * glm::two_pi<float>();
+    for (int k = 0; k < childCount; k++)
+    {
+        float t = species.childStart + (1.0f - species.childStart) * (k + 0.5f + 0.4f * signedRandom(context.rng)) / childCount;
+        t = min(max(t, 0.0f), 1.0f);
+
+        glm::vec3 point, axis;
+        float parentRadius;
+        pointAt(t, point, axis, parentRadius);
+
+        float azimuth = azimuthOffset + k * 2.39996f + 0.3f * signedRandom(context.rng);
+        glm::vec3 childSide = perpendicular(axis);
+        glm::vec3 outward = cos(azimuth) * childSide + sin(azimuth) * glm::cross(axis, childSide);
+        float angle = glm::radians(species.branchAngle * (0.8f + 0.4f * context.rng.NextFloat()));
+
+        BranchGrowth child;
+        child.origin = point;
+        child.direction = glm::normalize(cos(angle) * axis + sin(angle) * outward);
+        child.length = branch.length * species.lengthRatio * (1.2f - 0.5f * t);
+        child.radius = parentRadius * species.radiusRatio;
+        child.level = branch.level + 1;
+        growBranch(context, child);
+    }
+}
+
+// Quads between the chosen rings of a tube, every radialStep-th side; the last ring
+// is always kept so the branch keeps its length
+static void appendTube(const BranchTube &tube, int radial, int radialStep, int ringStep, vector<unsigned int> &indices)
+{
+    vector<int> rings;
+    for (int r = 0; r < tube.rings - 1; r += ringStep)
+        rings.push_back(r);
+    rings.push_back(tube.rings - 1);
+
+    for (size_t k = 0; k + 1 < rings.size(); k++)
+    {
+        unsigned int lower = tube.firstVertex + rings[k] * radial;
+        unsigned int upper = tube.firstVertex + rings[k + 1] * radial;
+        for (int j = 0; j < radial; j += radialStep)
+        {
+            int next = (j + radialStep) % radial;
+            unsigned int quad[6] = {lower + j, lower + next, upper + next,
+                                    lower + j, upper + next, upper + j};
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+GeneratedTree GenerateTree(const TreeSpecies &species)
+{
+    GeneratedTree tree;
+    int radial = max(4, species.radialSegments + (species.radialSegments & 1));
+    GrowContext context = {species, radial, PlacementRng(species.seed), tree, {}};
+
+    BranchGrowth trunk;
+    trunk.origin = glm::vec3(0.0f);
+    trunk.direction = glm::vec3(0.0f, 1.0f, 0.0f);
+    trunk.length = species.trunkLength;
+    trunk.radius = species.trunkRadius;
+    trunk.level = 0;
+    growBranch(context, trunk);
+
+    // Full detail, then every other side, then fewer rings; the levels a step drops
+    // stay as one-span stubs (first to last ring), so the leaf anchors on the twigs
+    // keep something under them
+    struct LODStep
+    {
+        int radialStep, ringStep, levelsDropped;
+    };
+    const LODStep steps[] = {{2, 1, 0}, {2, 2, 1}, {2, 4, 2}};
+
+    for (const BranchTube &tube : context.tubes)
+        appendTube(tube, radial, 1, 1, tree.indices);
+    for (const LODStep &step : steps)
+    {
+        vector<unsigned int> lod;
+        for (const BranchTube &tube : context.tubes)
+        {
+            bool kept = tube.level <= max(0, species.levels - step.levelsDropped);
+            appendTube(tube, radial, step.radialStep, kept ? step.ringStep : tube.rings, lod);
+        }
+        tree.lods.push_back(lod);
+    }
+    return tree;
+}
+
+vector<GeneratedTree> GenerateTrees(const vector<TreeSpecies> &species)
+{
+    // Every tree has its own seeded stream, so results do not depend on scheduling
+    vector<GeneratedTree> trees(species.size());
+    ParallelFor(species.size(), [&](size_t i) { trees[i] = GenerateTree(species[i]); });
+    return trees;
+}
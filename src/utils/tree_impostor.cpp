@@ -0,0 +1,239 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+#include "tree_impostor.h"
+
+// View basis of one frame: right and up span the frame, direction points at the camera.
+// Mirrored in impostor.vert
+static void frameBasis(const glm::vec3 &direction, glm::vec3 &right, glm::vec3 &up)
+{
+    if (fabs(direction.y) > 0.999f)
+        right = glm::vec3(1.0f, 0.0f, 0.0f);
+    else
+        right = glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), direction));
+    up = glm::cross(direction, right);
+}
+
+glm::vec2 TreeImpostor::EncodeDirection(const glm::vec3 &direction)
+{
+    glm::vec3 d = direction / (fabs(direction.x) + fabs(direction.y) + fabs(direction.z));
+    return glm::vec2(d.x + d.z, d.x - d.z);
+}
+
+glm::vec3 TreeImpostor::DecodeDirection(const glm::vec2 &uv)
+{
+    glm::vec2 p = glm::vec2(uv.x + uv.y, uv.x - uv.y) * 0.5f;
+    return glm::normalize(glm::vec3(p.x, 1.0f - fabs(p.x) - fabs(p.y), p.y));
+}
+
+TreeImpostor::TreeImpostor(TreeFoliage *tree, Shader &leafShader, Shader &branchShader,
+                           const TreeImpostorSettings &settings)
+    : settings(settings), boundsCenter(tree->GetBoundsCenter()), boundsRadius(tree->GetBoundsRadius())
+{
+    bake(tree, leafShader, branchShader);
+    setupQuad();
+
+    int atlasSize = settings.framesPerSide * settings.frameResolution;
+    cout << "Baked tree impostor: " << settings.framesPerSide * settings.framesPerSide << " frames, "
+         << atlasSize << "x" << atlasSize << " atlas, radius " << boundsRadius << endl;
+}
+
+TreeImpostor::~TreeImpostor()
+{
+    glDeleteTextures(1, &colourAtlas);
+    glDeleteTextures(1, &depthAtlas);
+    glDeleteVertexArrays(1, &quadVAO);
+    glDeleteBuffers(1, &quadVBO);
+    glDeleteBuffers(1, &quadEBO);
+    glDeleteBuffers(1, &instanceVBO);
+}
+
+void TreeImpostor::bake(TreeFoliage *tree, Shader &leafShader, Shader &branchShader)
+{
+    int frames = settings.framesPerSide;
+    int resolution = settings.frameResolution;
+    int atlasSize = frames * resolution;
+
+    glGenTextures(1, &colourAtlas);
+    glBindTexture(GL_TEXTURE_2D, colourAtlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Frames start on power-of-two boundaries, so a mip texel never mixes two frames;
+    // bilinear taps reach half a texel past the content, which the gutter absorbs up
+    // to level log2(gutter) + 1. Deeper levels would blend neighbouring frames
+    gutter = glm::clamp(settings.frameGutter, 0, resolution / 4);
+    int cleanLevels = gutter > 0 ? (int)floor(log2((float)gutter)) + 1 : 0;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, cleanLevels);
+
+    glGenTextures(1, &depthAtlas);
+    glBindTexture(GL_TEXTURE_2D, depthAtlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, atlasSize, atlasSize, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colourAtlas, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthAtlas, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cerr << "Tree impostor framebuffer incomplete, impostors will be empty" << endl;
+
+    // Remember the state the bake changes
+    GLint viewport[4];
+    GLfloat clearColour[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColour);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+
+    glViewport(0, 0, atlasSize, atlasSize);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Store premultiplied colour with the fragment's own alpha (no compositing, depth
+    // keeps the front-most), so mipmaps average cleanly
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ZERO, GL_ONE, GL_ZERO);
+
+    // leaf.frag's AO reads the world position and placed trees stand far from the
+    // origin, so bake the tree away from it as well
+    const glm::vec3 bakeOffset(1000.0f, 0.0f, 0.0f);
+    tree->SetInstances({{glm::translate(glm::mat4(1.0f), bakeOffset), 0.0f}});
+    leafShader.use();
+    leafShader.setFloat("time", 0.0f);
+    branchShader.use();
+    branchShader.setFloat("time", 0.0f);
+
+    // Orthographic box around the bounding sphere, the eye sits 2 radii out
+    glm::vec3 center = boundsCenter + bakeOffset;
+    float radius = boundsRadius;
+    glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+
+    for (int fy = 0; fy < frames; fy++)
+    {
+        for (int fx = 0; fx < frames; fx++)
+        {
+            glm::vec2 uv = (glm::vec2((float)fx, (float)fy) + 0.5f) / (float)frames * 2.0f - 1.0f;
+            glm::vec3 direction = DecodeDirection(uv);
+            glm::vec3 right, up;
+            frameBasis(direction, right, up);
+            glm::vec3 eye = center + direction * 2.0f * radius;
+
+            // Rows are the frame basis, built by hand so it matches impostor.vert exactly
+            glm::mat4 view(1.0f);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                view[axis][0] = right[axis];
+                view[axis][1] = up[axis];
+                view[axis][2] = direction[axis];
+            }
+            view[3][0] = -glm::dot(right, eye);
+            view[3][1] = -glm::dot(up, eye);
+            view[3][2] = -glm::dot(direction, eye);
+
+            // The frame's own gutter stays clear (zero alpha)
+            glViewport(fx * resolution + gutter, fy * resolution + gutter,
+                       resolution - 2 * gutter, resolution - 2 * gutter);
+            tree->Draw(leafShader, branchShader, view, projection, eye);
+        }
+    }
+
+    tree->SetInstances({});
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glClearColor(clearColour[0], clearColour[1], clearColour[2], clearColour[3]);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (!blend)
+        glDisable(GL_BLEND);
+
+    glBindTexture(GL_TEXTURE_2D, colourAtlas);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TreeImpostor::setupQuad()
+{
+    // Corners in [-1, 1], scaled by the bounding radius in the shader
+    float corners[] = {
+        -1.0f, -1.0f,
+        1.0f, -1.0f,
+        1.0f, 1.0f,
+        -1.0f, 1.0f};
+    unsigned int indices[] = {0, 1, 2, 2, 3, 0};
+
+    glGenVertexArrays(1, &quadVAO);
+    glGenBuffers(1, &quadVBO);
+    glGenBuffers(1, &quadEBO);
+    glGenBuffers(1, &instanceVBO);
+
+    glBindVertexArray(quadVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+
+    // Attributes 7-11: per tree, same layout as the full trees
+    BindTreeInstanceAttributes(instanceVBO);
+
+    glBindVertexArray(0);
+}
+
+void TreeImpostor::SetInstances(const vector<TreeDrawInstance> &instances)
+{
+    instanceCount = (GLsizei)instances.size();
+    if (instances.empty())
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (instances.size() > instanceCapacity)
+    {
+        instanceCapacity = instances.size() * 2;
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(TreeDrawInstance), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(TreeDrawInstance), instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TreeImpostor::Draw(Shader &shader, const glm::mat4 &view, const glm::mat4 &projection,
+                        const glm::vec3 &cameraPos)
+{
+    if (instanceCount == 0)
+        return;
+
+    shader.use();
+    shader.setMat4("view", view);
+    shader.setMat4("projection", projection);
+    shader.setVec3("cameraPos", cameraPos);
+    shader.setVec3("boundsCenter", boundsCenter);
+    shader.setFloat("boundsRadius", boundsRadius);
+    shader.setFloat("framesPerSide", (float)settings.framesPerSide);
+    shader.setFloat("frameInset", (float)gutter / (float)settings.frameResolution);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colourAtlas);
+    shader.setInt("impostorColour", 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depthAtlas);
+    shader.setInt("impostorDepth", 1);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(quadVAO);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, instanceCount);
+    glBindVertexArray(0);
+}
@@ -1,4 +1,8 @@
+#include <cfloat>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <map>
 using namespace std;
 
 #include "tree_manager.h"
@@ -12,101 +16,280 @@ TreeManager::TreeManager(Terrain *terrain, TreeFoliage *normalType, TreeFoliage
     generateTreePositions(count, exclusionCenter, exclusionRadius);
 }
 
-// UPDATED SIGNATURE - now accepts 3 parameters
+TreeManager::~TreeManager()
+{
+    for (TreeCluster &cluster : clusters)
+    {
+        if (cluster.query)
+            glDeleteQueries(1, &cluster.query);
+    }
+    if (boxVAO)
+    {
+        glDeleteVertexArrays(1, &boxVAO);
+        glDeleteBuffers(1, &boxVBO);
+        glDeleteBuffers(1, &boxEBO);
+    }
+}
+
 void TreeManager::generateTreePositions(int desiredCount, glm::vec3 exclusionCenter, float exclusionRadius)
 {
-    std::mt19937 rng(42);
-    std::uniform_real_distribution<float> distX(-50.0f, 50.0f);
-    std::uniform_real_distribution<float> distZ(-50.0f, 50.0f);
-    std::uniform_real_distribution<float> distScale(2.0f, 4.0f);
-    std::uniform_real_distribution<float> distRot(0.0f, 360.0f);
-    std::uniform_real_distribution<float> distType(0.0f, 1.0f);
-
-    int attempts = desiredCount * 3;
+    auto start = chrono::high_resolution_clock::now();
+
+    // Where trees may grow: moderate slopes, no valleys or peaks, not in the clearing
     float terrainHeightScale = terrain->heightScale;
+    DensityRules rules;
+    rules.minNormalY = 0.7f;
+    rules.minHeight = -terrainHeightScale * 0.2f;
+    rules.maxHeight = terrainHeightScale * 0.8f;
+    rules.exclusions.push_back({glm::vec2(exclusionCenter.x, exclusionCenter.z), exclusionRadius});
 
-    for (int i = 0; i < attempts && static_cast<int>(trees.size()) < desiredCount; i++)
+    DensityMap densityMap(terrain, rules);
+    if (densityMap.IsEmpty())
     {
-        float x = distX(rng);
-        float z = distZ(rng);
-        float y = terrain->getHeight(x, z);
-        glm::vec3 normal = terrain->getNormal(x, z);
+        cerr << "No terrain accepts trees - nothing placed" << endl;
+        return;
+    }
+
+    // Every sample lands on valid terrain; only the spacing test can still reject.
+    // Thick trees have the wider crown, so they keep more room around them
+    TreePlacementSettings settings;
+    settings.count = desiredCount;
+    settings.spacingRadius[TREE_NORMAL] = 2.0f;
+    settings.spacingRadius[TREE_THICK] = 2.5f;
+    vector<TreePlacement> placements = PlaceTrees(densityMap, settings);
+
+    trees.reserve(placements.size());
+    for (const TreePlacement &placement : placements)
+    {
+        TreeInstance tree;
+        tree.position = glm::vec3(placement.position.x,
+                                  terrain->getHeight(placement.position.x, placement.position.y),
+                                  placement.position.y);
+        tree.scale = placement.scale;
+        tree.rotation = placement.rotation;
+        tree.useThickType = placement.type == TREE_THICK;
+
+        // Trees never move, build the model matrix once
+        tree.model = glm::translate(glm::mat4(1.0f), tree.position);
+        tree.model = glm::scale(tree.model, glm::vec3(tree.scale));
+        tree.model = glm::rotate(tree.model, glm::radians(tree.rotation), glm::vec3(0, 1, 0));
+
+        // Sphere around the type's actual branch and leaf extents
+        TreeFoliage *type = tree.useThickType ? thickTree : normalTree;
+        tree.boundsCenter = glm::vec3(tree.model * glm::vec4(type->GetBoundsCenter(), 1.0f));
+        tree.boundingRadius = type->GetBoundsRadius() * tree.scale;
+        trees.push_back(tree);
+    }
 
-        // Check terrain suitability - RELAXED from 0.85 to 0.7
-        if (normal.y > 0.7f && // Trees can handle moderate slopes now
-            y > -terrainHeightScale * 0.2f &&
-            y < terrainHeightScale * 0.8f)
+    // Trees never move, so the hierarchy is built once
+    vector<BoundingSphere> spheres;
+    spheres.reserve(trees.size());
+    for (const TreeInstance &tree : trees)
+        spheres.push_back({tree.boundsCenter, tree.boundingRadius});
+    treeBVH.Build(spheres);
+    buildClusters();
+
+    auto end = chrono::high_resolution_clock::now();
+    cout << "Placed " << trees.size() << " / " << desiredCount << " trees in "
+         << chrono::duration<float, milli>(end - start).count() << " ms" << endl;
+}
+
+void TreeManager::buildClusters()
+{
+    // Trees sharing a grid cell form one cluster. The boxes hold each tree's whole
+    // bounding sphere: a box that is too small would hide trees
+    clusters.clear();
+    map<pair<int, int>, uint32_t> cellClusters;
+    for (TreeInstance &tree : trees)
+    {
+        pair<int, int> cell((int)floor(tree.position.x / clusterSize), (int)floor(tree.position.z / clusterSize));
+        auto found = cellClusters.find(cell);
+        if (found == cellClusters.end())
         {
+            found = cellClusters.emplace(cell, (uint32_t)clusters.size()).first;
+            TreeCluster cluster;
+            cluster.min = glm::vec3(FLT_MAX);
+            cluster.max = glm::vec3(-FLT_MAX);
+            clusters.push_back(cluster);
+        }
+        tree.cluster = found->second;
 
-            // Check if too close to exclusion zone
-            float distToExclusion = glm::distance(
-                glm::vec2(x, z),
-                glm::vec2(exclusionCenter.x, exclusionCenter.z));
+        TreeCluster &cluster = clusters[tree.cluster];
+        cluster.min = glm::min(cluster.min, tree.boundsCenter - glm::vec3(tree.boundingRadius));
+        cluster.max = glm::max(cluster.max, tree.boundsCenter + glm::vec3(tree.boundingRadius));
+    }
+    clusterTreeCounts.assign(clusters.size(), 0);
+    clusterConditional.assign(clusters.size(), 0);
+    clusterOffsets.assign(clusters.size(), 0);
 
-            if (distToExclusion < exclusionRadius)
-                continue;
+    cout << "Grouped trees into " << clusters.size() << " occlusion clusters" << endl;
+}
 
-            // Check spacing from other trees
-            bool tooClose = false;
-            float minSpacing = 4.0f;
-            for (const auto &existing : trees)
-            {
-                float dist = glm::distance(glm::vec2(x, z),
-                                           glm::vec2(existing.position.x, existing.position.z));
-                if (dist < minSpacing)
-                {
-                    tooClose = true;
-                    break;
-                }
-            }
+void TreeManager::SetOcclusionCulling(Shader *boxShader)
+{
+    occlusionShader = boxShader;
+    if (!occlusionShader || boxVAO)
+        return;
 
-            if (!tooClose)
-            {
-                TreeInstance tree;
-                tree.position = glm::vec3(x, y, z);
-                tree.scale = distScale(rng);
-                tree.rotation = distRot(rng);
-                tree.useThickType = distType(rng) < 0.5f;
-                tree.boundingRadius = tree.scale * 3.0f;
-                trees.push_back(tree);
-            }
+    for (TreeCluster &cluster : clusters)
+        glGenQueries(1, &cluster.query);
+
+    // Unit cube, scaled onto each cluster box in the vertex shader
+    float corners[] = {
+        0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0,
+        0, 0, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1};
+    unsigned int indices[] = {
+        0, 1, 2, 0, 2, 3, // back
+        4, 6, 5, 4, 7, 6, // front
+        0, 3, 7, 0, 7, 4, // left
+        1, 5, 6, 1, 6, 2, // right
+        0, 4, 5, 0, 5, 1, // bottom
+        3, 2, 6, 3, 6, 7  // top
+    };
+
+    glGenVertexArrays(1, &boxVAO);
+    glGenBuffers(1, &boxVBO);
+    glGenBuffers(1, &boxEBO);
+    glBindVertexArray(boxVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+    glBindVertexArray(0);
+}
+
+bool TreeManager::cameraInCluster(const TreeCluster &cluster, const glm::vec3 &cameraPos) const
+{
+    // With the near plane inside the box its front faces get clipped and the query
+    // could report it hidden; such clusters are always drawn
+    const float margin = 1.0f;
+    return cameraPos.x > cluster.min.x - margin && cameraPos.x < cluster.max.x + margin &&
+           cameraPos.y > cluster.min.y - margin && cameraPos.y < cluster.max.y + margin &&
+           cameraPos.z > cluster.min.z - margin && cameraPos.z < cluster.max.z + margin;
+}
+
+void TreeManager::groupByCluster(bool useImpostors)
+{
+    // Full-geometry trees of one cluster become contiguous so the cluster can be drawn
+    // under its own condition. Clusters keep the order of their first tree (the farthest
+    // when sorted back-to-front), trees keep their order inside the cluster. Impostors
+    // are not queried and go first, in their own order
+    for (uint32_t c : drawnClusters)
+        clusterTreeCounts[c] = 0;
+    drawnClusters.clear();
+
+    auto isFull = [&](const TreeInstance &tree)
+    { return !(useImpostors && tree.lodLevel >= impostorLevel); };
+
+    uint32_t impostorCount = 0;
+    for (uint32_t t : visibleTrees)
+    {
+        const TreeInstance &tree = trees[t];
+        if (!isFull(tree))
+            impostorCount++;
+        else if (clusterTreeCounts[tree.cluster]++ == 0)
+            drawnClusters.push_back(tree.cluster);
+    }
+
+    uint32_t offset = impostorCount;
+    for (uint32_t c : drawnClusters)
+    {
+        clusterOffsets[c] = offset;
+        offset += clusterTreeCounts[c];
+    }
+
+    groupedTrees.resize(visibleTrees.size());
+    groupedDithers.resize(visibleDithers.size());
+    uint32_t impostorSlot = 0;
+    for (size_t i = 0; i < visibleTrees.size(); i++)
+    {
+        const TreeInstance &tree = trees[visibleTrees[i]];
+        uint32_t slot = isFull(tree) ? clusterOffsets[tree.cluster]++ : impostorSlot++;
+        groupedTrees[slot] = visibleTrees[i];
+        groupedDithers[slot] = visibleDithers[i];
+    }
+    visibleTrees.swap(groupedTrees);
+    visibleDithers.swap(groupedDithers);
+}
+
+void TreeManager::IssueOcclusionQueries(const glm::mat4 &view, const glm::mat4 &projection, const Camera &camera)
+{
+    if (!occlusionEnabled())
+        return;
+
+    // Boxes test against everything drawn so far, trees included, and write nothing
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    GLboolean depthMask;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    glDisable(GL_CULL_FACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+
+    occlusionShader->use();
+    occlusionShader->setMat4("view", view);
+    occlusionShader->setMat4("projection", projection);
+    glBindVertexArray(boxVAO);
+    for (uint32_t c : drawnClusters)
+    {
+        TreeCluster &cluster = clusters[c];
+        if (cameraInCluster(cluster, camera.Position))
+        {
+            cluster.queryFrame = -1;
+            continue;
         }
+
+        occlusionShader->setVec3("boxMin", cluster.min);
+        occlusionShader->setVec3("boxMax", cluster.max);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, cluster.query);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        cluster.queryFrame = frameIndex;
     }
+    glBindVertexArray(0);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(depthMask);
+    if (cullFace)
+        glEnable(GL_CULL_FACE);
 }
 
 void TreeManager::Draw(Shader &leafShader, Shader &branchShader,
                        const glm::mat4 &view, const glm::mat4 &projection,
                        const Camera::Frustum &frustum, const Camera &camera)
 {
+    // Bands for the current projection (projected-size LOD)
+    const LODConfig lod = lodConfig.ForProjection(frustum.fovY, frustum.viewportHeight);
+    frameIndex++;
+
     visibleCount = 0;
     int nearCount = 0, midCount = 0, farCount = 0;
+    visibleTrees.clear();
+    visibleDithers.clear();
+    visibleDepths.clear();
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Hierarchical frustum and range culling; everything beyond farDistance is level 3
+    // (culled), hysteresis never holds a tree past it
+    candidateTrees.clear();
+    bvhNodesVisited = treeBVH.Cull(frustum, camera.Position, lod.farDistance, candidateTrees);
 
-    for (const auto &tree : trees)
+    for (uint32_t t : candidateTrees)
     {
-        // Frustum culling
-        if (!camera.IsSphereInFrustum(frustum, tree.position, tree.boundingRadius))
-        {
-            continue;
-        }
+        TreeInstance &tree = trees[t];
 
         // LOD distance check
         float distance = glm::distance(camera.Position, tree.position);
-        int lodLevel = lodConfig.GetLODLevel(tree.position, camera.Position);
+        int lodLevel = lod.GetLODLevel(distance, tree.lodLevel);
+        tree.lodLevel = lodLevel;
 
         if (lodLevel >= 3)
             continue; // Too far, cull
+        if (distance > lod.GetScreenCutoff(tree.boundingRadius))
+            continue; // Too small on screen
 
         visibleCount++;
 
-        // Build model matrix
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, tree.position);
-        model = glm::scale(model, glm::vec3(tree.scale));
-        model = glm::rotate(model, glm::radians(tree.rotation), glm::vec3(0, 1, 0));
-
         if (lodLevel == 0)
             nearCount++;
         else if (lodLevel == 1)
@@ -114,16 +297,151 @@ void TreeManager::Draw(Shader &leafShader, Shader &branchShader,
         else
             farCount++;
 
-        // Draw tree
-        if (tree.useThickType)
+        // Dissolve over the fade band instead of popping at farDistance
+        visibleTrees.push_back(t);
+        visibleDithers.push_back(lod.fadeBand > 0.0f ? 1.0f - lod.GetFadeFactor(distance) : 0.0f);
+        visibleDepths.push_back(DepthSorter::ViewDepth(tree.position, camera.Position, camera.Front));
+    }
+
+    // Leaves are alpha-blended, so draw the trees back-to-front
+    if (depthOrder != DepthOrder::NONE)
+    {
+        depthSorter.Sort(visibleDepths.data(), visibleDepths.size(), lod.farDistance, depthOrder);
+        depthSorter.Apply(visibleTrees);
+        depthSorter.Apply(visibleDithers);
+    }
+
+    bool useImpostors = normalImpostor && thickImpostor && impostorShader;
+    bool useOcclusion = occlusionEnabled();
+    occludedTreeCount = 0;
+    occludedClusterCount = 0;
+    if (useOcclusion)
+    {
+        groupByCluster(useImpostors);
+
+        // A cluster queried last frame draws under that query's result. The count below
+        // only reads results that are already in, it never waits for the GPU
+        for (uint32_t c : drawnClusters)
         {
-            thickTree->Draw(leafShader, branchShader, model, view, projection, camera.Position);
+            const TreeCluster &cluster = clusters[c];
+            clusterConditional[c] = cluster.queryFrame == frameIndex - 1 && !cameraInCluster(cluster, camera.Position);
+            if (!clusterConditional[c])
+                continue;
+
+            GLuint available = 0, samplesPassed = 1;
+            glGetQueryObjectuiv(cluster.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+                glGetQueryObjectuiv(cluster.query, GL_QUERY_RESULT, &samplesPassed);
+            if (!samplesPassed)
+            {
+                occludedClusterCount++;
+                occludedTreeCount += clusterTreeCounts[c];
+            }
         }
+    }
+
+    // Split into one instance list per type, keeping the sorted order within each;
+    // distant trees go to the type's impostor instead
+    normalInstances.clear();
+    thickInstances.clear();
+    normalLods.clear();
+    thickLods.clear();
+    normalImpostorInstances.clear();
+    thickImpostorInstances.clear();
+    normalSegments.clear();
+    thickSegments.clear();
+    for (size_t i = 0; i < visibleTrees.size(); i++)
+    {
+        const TreeInstance &tree = trees[visibleTrees[i]];
+        TreeDrawInstance instance = {tree.model, visibleDithers[i]};
+        if (useImpostors && tree.lodLevel >= impostorLevel)
+            (tree.useThickType ? thickImpostorInstances : normalImpostorInstances).push_back(instance);
         else
         {
-            normalTree->Draw(leafShader, branchShader, model, view, projection, camera.Position);
+            // Branch mesh LOD and leaf prefix follow the tree's LOD level
+            (tree.useThickType ? thickInstances : normalInstances).push_back(instance);
+            (tree.useThickType ? thickLods : normalLods).push_back(tree.lodLevel);
+            if (useOcclusion)
+                (tree.useThickType ? thickSegments : normalSegments).push_back((int)tree.cluster);
         }
     }
+    normalTree->SetInstances(normalInstances, normalLods, normalSegments);
+    thickTree->SetInstances(thickInstances, thickLods, thickSegments);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Impostors first, they are the farthest trees
+    if (useImpostors)
+    {
+        normalImpostor->SetInstances(normalImpostorInstances);
+        thickImpostor->SetInstances(thickImpostorInstances);
+        normalImpostor->Draw(*impostorShader, view, projection, camera.Position);
+        thickImpostor->Draw(*impostorShader, view, projection, camera.Position);
+    }
+
+    TreeFoliage *types[] = {normalTree, thickTree};
+    if (oitLeafShader)
+    {
+        // Leaves wait for DrawTransparent, in the OIT accumulation pass
+        auto branches = [&](int segment)
+        {
+            for (TreeFoliage *type : types)
+                type->DrawBranches(branchShader, view, projection, camera.Position, segment);
+        };
+        forEachCluster(branches);
+
+        // Their alpha-tested depth is opaque for everything after
+        if (oitLeafDepthShader)
+        {
+            DepthPrepass::BeginDepthPass();
+            auto leafDepth = [&](int segment)
+            {
+                for (TreeFoliage *type : types)
+                    type->DrawLeaves(*oitLeafDepthShader, view, projection, camera.Position, segment);
+            };
+            forEachCluster(leafDepth);
+            DepthPrepass::End();
+        }
+    }
+    else if (prepass.Enabled())
+    {
+        // Leaf depth first; branches then draw normally so they can still hide
+        // leaves behind them, and the leaf colour pass matches what is left
+        DepthPrepass::BeginDepthPass();
+        auto leafDepth = [&](int segment)
+        {
+            for (TreeFoliage *type : types)
+                type->DrawLeaves(*prepass.depth, view, projection, camera.Position, segment);
+        };
+        forEachCluster(leafDepth);
+        DepthPrepass::End();
+
+        auto branches = [&](int segment)
+        {
+            for (TreeFoliage *type : types)
+                type->DrawBranches(branchShader, view, projection, camera.Position, segment);
+        };
+        forEachCluster(branches);
+
+        DepthPrepass::BeginColourPass();
+        auto leafColour = [&](int segment)
+        {
+            for (TreeFoliage *type : types)
+                type->DrawLeaves(*prepass.colour, view, projection, camera.Position, segment);
+        };
+        forEachCluster(leafColour);
+        DepthPrepass::End();
+    }
+    else
+    {
+        auto wholeTrees = [&](int segment)
+        {
+            for (TreeFoliage *type : types)
+                type->Draw(leafShader, branchShader, view, projection, camera.Position, segment);
+        };
+        forEachCluster(wholeTrees);
+    }
 
     glDisable(GL_BLEND);
 
@@ -131,8 +449,51 @@ void TreeManager::Draw(Shader &leafShader, Shader &branchShader,
     static int frameCount = 0;
     if (++frameCount % 60 == 0)
     {
+        int impostorDraws = useImpostors ? normalImpostor->GetDrawCount() + thickImpostor->GetDrawCount() : 0;
         std::cout << "Trees: " << visibleCount << " / " << trees.size()
-                  << " (Near: " << nearCount << ", Mid: " << midCount << ", Far: " << farCount << ")"
-                  << std::endl;
+                  << " in " << normalTree->GetDrawCount() + thickTree->GetDrawCount() + impostorDraws << " draws"
+                  << ", " << normalTree->GetBranchTriangleCount() + thickTree->GetBranchTriangleCount() << " branch tris"
+                  << ", " << normalTree->GetLeafCount() + thickTree->GetLeafCount() << " leaves"
+                  << ", " << normalImpostorInstances.size() + thickImpostorInstances.size() << " impostors"
+                  << " (Near: " << nearCount << ", Mid: " << midCount << ", Far: " << farCount
+                  << ", " << bvhNodesVisited << " / " << treeBVH.GetNodeCount() << " BVH nodes"
+                  << ", " << occludedTreeCount << " occluded in " << occludedClusterCount << " / "
+                  << drawnClusters.size() << " clusters"
+                  << ", depth sort " << depthSorter.GetLastSortMs() << " ms"
+                  << (oitLeafShader ? ", leaves OIT" : (prepass.Enabled() ? ", leaf depth prepass" : ""))
+                  << ")" << std::endl;
+    }
+}
+
+void TreeManager::DrawTransparent(const glm::mat4 &view, const glm::mat4 &projection, const Camera &camera)
+{
+    if (!oitLeafShader)
+        return;
+
+    // Same trees and clusters as the last Draw; blend and depth state are the OIT pass's
+    auto leaves = [&](int segment)
+    {
+        normalTree->DrawLeaves(*oitLeafShader, view, projection, camera.Position, segment);
+        thickTree->DrawLeaves(*oitLeafShader, view, projection, camera.Position, segment);
+    };
+    forEachCluster(leaves);
+}
+
+void TreeManager::forEachCluster(const function<void(int)> &draw)
+{
+    // Once for all trees, or once per cluster (far to near) with the draws of clusters
+    // the last query found hidden skipped by the GPU
+    if (!occlusionEnabled())
+    {
+        draw(-1);
+        return;
+    }
+    for (uint32_t c : drawnClusters)
+    {
+        if (clusterConditional[c])
+            glBeginConditionalRender(clusters[c].query, GL_QUERY_NO_WAIT);
+        draw((int)c);
+        if (clusterConditional[c])
+            glEndConditionalRender();
     }
 }
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include "tree_placement.h"
+#include "parallel_for.h"
+
+vector<TreePlacement> PlaceTrees(const DensityMap &densityMap, const TreePlacementSettings &settings)
+{
+    vector<TreePlacement> result;
+    if (settings.count <= 0 || densityMap.IsEmpty())
+        return result;
+
+    // Candidates, each from its own stream so they don't depend on scheduling
+    const size_t candidateCount = (size_t)settings.count * max(1, settings.candidatesPerTree);
+    const size_t chunkSize = 4096;
+    vector<TreePlacement> candidates(candidateCount);
+    ParallelFor((candidateCount + chunkSize - 1) / chunkSize, [&](size_t chunk)
+    {
+        size_t end = min(candidateCount, (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; i++)
+        {
+            PlacementRng rng(HashCombine(settings.seed, (uint32_t)i));
+            TreePlacement &candidate = candidates[i];
+            candidate.position = densityMap.Sample(rng);
+            candidate.type = rng.NextFloat() < settings.thickShare ? TREE_THICK : TREE_NORMAL;
+            candidate.scale = settings.minScale + rng.NextFloat() * (settings.maxScale - settings.minScale);
+            candidate.rotation = rng.NextFloat() * 360.0f;
+        }
+    });
+
+    // Grid over the candidates: a cell spans the largest spacing of any pair
+    float maxRadius = 0.0f, minRadius = settings.spacingRadius[0];
+    for (float radius : settings.spacingRadius)
+    {
+        maxRadius = max(maxRadius, radius);
+        minRadius = min(minRadius, radius);
+    }
+    const float cellSize = max(2.0f * maxRadius, 1e-3f);
+
+    glm::vec2 minCorner = candidates[0].position, maxCorner = candidates[0].position;
+    for (const auto &candidate : candidates)
+    {
+        minCorner = glm::min(minCorner, candidate.position);
+        maxCorner = glm::max(maxCorner, candidate.position);
+    }
+    const int gridW = (int)((maxCorner.x - minCorner.x) / cellSize) + 1;
+    const int gridH = (int)((maxCorner.y - minCorner.y) / cellSize) + 1;
+
+    auto cellOf = [&](const glm::vec2 &p)
+    {
+        int cx = min(gridW - 1, (int)((p.x - minCorner.x) / cellSize));
+        int cz = min(gridH - 1, (int)((p.y - minCorner.y) / cellSize));
+        return glm::ivec2(cx, cz);
+    };
+
+    // Fixed slots per cell: accepted trees are at least 2 * minRadius apart
+    const int perSide = min(15, (int)ceil(cellSize / max(2.0f * minRadius, 1e-3f)) + 1);
+    const int slots = perSide * perSide;
+    vector<uint32_t> cellTrees((size_t)gridW * gridH * slots);
+    vector<uint8_t> cellCount((size_t)gridW * gridH, 0);
+
+    // Bucket candidates by tile, keeping index order within each (deterministic)
+    const int tileCells = max(2, settings.tileCells);
+    const int tilesX = (gridW + tileCells - 1) / tileCells;
+    const int tilesZ = (gridH + tileCells - 1) / tileCells;
+    vector<uint32_t> tileStart(tilesX * tilesZ + 1, 0);
+    vector<uint32_t> tileOf(candidateCount);
+    for (size_t i = 0; i < candidateCount; i++)
+    {
+        glm::ivec2 cell = cellOf(candidates[i].position);
+        tileOf[i] = (cell.y / tileCells) * tilesX + cell.x / tileCells;
+        tileStart[tileOf[i] + 1]++;
+    }
+    for (size_t t = 1; t < tileStart.size(); t++)
+        tileStart[t] += tileStart[t - 1];
+    vector<uint32_t> tileCandidates(candidateCount);
+    {
+        vector<uint32_t> fill(tileStart.begin(), tileStart.end() - 1);
+        for (size_t i = 0; i < candidateCount; i++)
+            tileCandidates[fill[tileOf[i]]++] = (uint32_t)i;
+    }
+
+    vector<uint8_t> accepted(candidateCount, 0);
+
+    auto processTile = [&](int tile)
+    {
+        for (uint32_t k = tileStart[tile]; k < tileStart[tile + 1]; k++)
+        {
+            uint32_t i = tileCandidates[k];
+            const TreePlacement &candidate = candidates[i];
+            float radius = settings.spacingRadius[candidate.type];
+            glm::ivec2 cell = cellOf(candidate.position);
+
+            // Spacing check against the 3x3 neighbourhood
+            bool tooClose = false;
+            for (int nz = max(0, cell.y - 1); nz <= min(gridH - 1, cell.y + 1) && !tooClose; nz++)
+            {
+                for (int nx = max(0, cell.x - 1); nx <= min(gridW - 1, cell.x + 1) && !tooClose; nx++)
+                {
+                    size_t n = (size_t)nz * gridW + nx;
+                    for (int s = 0; s < cellCount[n]; s++)
+                    {
+                        const TreePlacement &other = candidates[cellTrees[n * slots + s]];
+                        float spacing = radius + settings.spacingRadius[other.type];
+                        glm::vec2 d = other.position - candidate.position;
+                        if (glm::dot(d, d) < spacing * spacing)
+                        {
+                            tooClose = true;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            size_t c = (size_t)cell.y * gridW + cell.x;
+            if (tooClose || cellCount[c] >= slots)
+                continue;
+
+            cellTrees[c * slots + cellCount[c]++] = i;
+            accepted[i] = 1;
+        }
+    };
+
+    // Tiles of the same phase (tx % 2, tz % 2) are a full tile apart and a candidate
+    // only looks one cell beyond its own, so same-phase tiles never touch each other
+    for (int phase = 0; phase < 4; phase++)
+    {
+        vector<int> phaseTiles;
+        for (int tz = phase / 2; tz < tilesZ; tz += 2)
+            for (int tx = phase % 2; tx < tilesX; tx += 2)
+                phaseTiles.push_back(tz * tilesX + tx);
+
+        ParallelFor(phaseTiles.size(), [&](size_t t) { processTile(phaseTiles[t]); });
+    }
+
+    // Keep the lowest-index survivors; candidates are random, so cutting at the
+    // count thins the forest evenly
+    for (size_t i = 0; i < candidateCount && (int)result.size() < settings.count; i++)
+    {
+        if (accepted[i])
+            result.push_back(candidates[i]);
+    }
+    return result;
+}
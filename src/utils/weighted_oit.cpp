@@ -0,0 +1,132 @@
+#include <iostream>
+using namespace std;
+
+#include "weighted_oit.h"
+
+WeightedOIT::~WeightedOIT()
+{
+    release();
+    if (emptyVAO)
+        glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void WeightedOIT::release()
+{
+    if (!framebuffer)
+        return;
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &accumTexture);
+    glDeleteTextures(1, &weightTexture);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    framebuffer = accumTexture = weightTexture = depthBuffer = 0;
+}
+
+void WeightedOIT::Resize(int newWidth, int newHeight)
+{
+    if (framebuffer && newWidth == width && newHeight == height)
+        return;
+    if (newWidth <= 0 || newHeight <= 0)
+        return; // minimised
+
+    release();
+    width = newWidth;
+    height = newHeight;
+
+    auto createTarget = [&](GLenum internalFormat, GLenum format)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    };
+    accumTexture = createTarget(GL_RGBA16F, GL_RGBA);
+    weightTexture = createTarget(GL_R16F, GL_RED);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Same format as the usual default depth buffer, which the depth blit requires
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cerr << "ERROR: OIT framebuffer is not complete" << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    cout << "OIT targets: " << width << "x" << height << endl;
+}
+
+void WeightedOIT::BeginAccumulation()
+{
+    if (!framebuffer)
+        return;
+
+    // Opaque geometry drawn so far still hides the layers behind it
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    // Nothing accumulated yet: no colour, everything revealed
+    const float clearAccum[] = {0.0f, 0.0f, 0.0f, 1.0f};
+    const float clearWeight[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, clearAccum);
+    glClearBufferfv(GL_COLOR, 1, clearWeight);
+
+    // RGB of both targets sum, A multiplies by (1 - alpha): the revealage
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+
+    // Layers whose alpha-tested depth is already in the buffer still pass on it
+    glDepthFunc(GL_LEQUAL);
+}
+
+void WeightedOIT::Composite(Shader &compositeShader)
+{
+    if (!framebuffer)
+        return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+
+    if (!emptyVAO)
+        glGenVertexArrays(1, &emptyVAO);
+
+    // Average colour, covering (1 - revealage) of what is behind
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    compositeShader.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTexture);
+    compositeShader.setInt("accumTexture", 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, weightTexture);
+    compositeShader.setInt("weightTexture", 1);
+
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+}